@@ -0,0 +1,247 @@
+#pragma once
+
+#include <atomic>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <new>
+#include <vector>
+#include <stddef.h>
+#include <stdint.h>
+
+namespace net
+{
+  /**
+   * 按大小分级的内存池，用于 message 的 body
+   * - 大小分为 64B、128B ... 64KiB 共 11 级，每次分配向上取整到对应级别，超过 64KiB 的直接 new
+   * - 每个线程有自己的缓存，分配和释放大部分情况下不需要加锁
+   * - 线程缓存满了会把一半还给全局链表，缓存空了再从全局链表取，所以 I/O 线程分配、Update 线程释放这种跨线程的用法也能复用内存
+   * - 内存块只会复用不会还给系统，占用的内存等于峰值
+   */
+  class buffer_pool
+  {
+  public:
+    static constexpr size_t MinBlockBytes = 64;
+    static constexpr size_t NumClasses = 11;
+    static constexpr size_t MaxBlockBytes = MinBlockBytes << (NumClasses - 1);
+    // 每个线程每一级最多缓存的内存块个数
+    static constexpr size_t CacheBlocks = 64;
+
+    struct stats
+    {
+      // 向系统申请池内存块的次数，稳定运行后应该不再增长
+      uint64_t mallocs = 0;
+      // 超过 MaxBlockBytes，不经过池直接分配的次数
+      uint64_t largeAllocs = 0;
+    };
+
+    static void *Allocate(size_t bytes)
+    {
+      if (bytes > MaxBlockBytes)
+      {
+        Counters().largeAllocs++;
+        return ::operator new(bytes);
+      }
+
+      size_t index = ClassIndex(bytes);
+      thread_cache &cache = Cache();
+      if (cache.heads[index] == nullptr)
+        cache.Refill(index);
+
+      free_block *block = cache.heads[index];
+      if (block == nullptr)
+      {
+        Counters().mallocs++;
+        return ::operator new(ClassBytes(index));
+      }
+
+      cache.heads[index] = block->next;
+      cache.counts[index]--;
+      return block;
+    }
+
+    static void Deallocate(void *p, size_t bytes)
+    {
+      if (p == nullptr)
+        return;
+
+      if (bytes > MaxBlockBytes)
+      {
+        ::operator delete(p);
+        return;
+      }
+
+      size_t index = ClassIndex(bytes);
+      thread_cache &cache = Cache();
+      free_block *block = static_cast<free_block *>(p);
+      block->next = cache.heads[index];
+      cache.heads[index] = block;
+      cache.counts[index]++;
+
+      if (cache.counts[index] > CacheBlocks)
+        cache.Release(index, CacheBlocks / 2);
+    }
+
+    static stats Stats()
+    {
+      stats s;
+      s.mallocs = Counters().mallocs.load(std::memory_order_relaxed);
+      s.largeAllocs = Counters().largeAllocs.load(std::memory_order_relaxed);
+      return s;
+    }
+
+  private:
+    struct free_block
+    {
+      free_block *next;
+    };
+
+    struct central_list
+    {
+      std::mutex _mutex;
+      free_block *head = nullptr;
+    };
+
+    struct counters
+    {
+      std::atomic<uint64_t> mallocs{0};
+      std::atomic<uint64_t> largeAllocs{0};
+    };
+
+    struct thread_cache
+    {
+      free_block *heads[NumClasses] = {};
+      size_t counts[NumClasses] = {};
+
+      // 从全局链表取最多 CacheBlocks / 2 个内存块
+      void Refill(size_t index)
+      {
+        central_list &central = Central()[index];
+        std::lock_guard<std::mutex> lock(central._mutex);
+        while (central.head != nullptr && counts[index] < CacheBlocks / 2)
+        {
+          free_block *block = central.head;
+          central.head = block->next;
+          block->next = heads[index];
+          heads[index] = block;
+          counts[index]++;
+        }
+      }
+
+      // 还 n 个内存块给全局链表
+      void Release(size_t index, size_t n)
+      {
+        central_list &central = Central()[index];
+        std::lock_guard<std::mutex> lock(central._mutex);
+        while (heads[index] != nullptr && n > 0)
+        {
+          free_block *block = heads[index];
+          heads[index] = block->next;
+          block->next = central.head;
+          central.head = block;
+          counts[index]--;
+          n--;
+        }
+      }
+
+      // 线程退出时，缓存的内存块全部还给全局链表
+      ~thread_cache()
+      {
+        for (size_t i = 0; i < NumClasses; i++)
+          Release(i, counts[i]);
+      }
+    };
+
+    static size_t ClassIndex(size_t bytes)
+    {
+      size_t index = 0;
+      size_t blockBytes = MinBlockBytes;
+      while (blockBytes < bytes)
+      {
+        blockBytes <<= 1;
+        index++;
+      }
+      return index;
+    }
+
+    static size_t ClassBytes(size_t index)
+    {
+      return MinBlockBytes << index;
+    }
+
+    // 全局链表和计数器故意不释放，避免静态对象析构顺序导致线程缓存析构时访问已经释放的内存
+    static central_list *Central()
+    {
+      static central_list *lists = new central_list[NumClasses];
+      return lists;
+    }
+
+    static counters &Counters()
+    {
+      static counters *c = new counters();
+      return *c;
+    }
+
+    static thread_cache &Cache()
+    {
+      thread_local thread_cache cache;
+      return cache;
+    }
+  };
+
+  /**
+   * 从 buffer_pool 分配内存的 allocator，可以直接用于 std::vector
+   */
+  template <typename T>
+  struct pool_allocator
+  {
+    using value_type = T;
+
+    pool_allocator() = default;
+    template <typename U>
+    pool_allocator(const pool_allocator<U> &) {}
+
+    T *allocate(size_t n)
+    {
+      return static_cast<T *>(buffer_pool::Allocate(n * sizeof(T)));
+    }
+
+    void deallocate(T *p, size_t n)
+    {
+      buffer_pool::Deallocate(p, n * sizeof(T));
+    }
+
+    template <typename U>
+    bool operator==(const pool_allocator<U> &) const { return true; }
+    template <typename U>
+    bool operator!=(const pool_allocator<U> &) const { return false; }
+  };
+
+  /**
+   * 节点从 buffer_pool 分配的 deque，用于收发消息的队列
+   * 一个 deque 节点 512 字节，放 8 个 owned_message，用 std::allocator 时每收 8 条消息就要 new 一次
+   */
+  template <typename T>
+  using pooled_deque = std::deque<T, pool_allocator<T>>;
+
+  /**
+   * message body 的类型，定义 NET_DISABLE_BUFFER_POOL 后使用默认的 std::allocator
+   */
+#ifdef NET_DISABLE_BUFFER_POOL
+  using body_buffer = std::vector<uint8_t>;
+#else
+  using body_buffer = std::vector<uint8_t, pool_allocator<uint8_t>>;
+#endif
+
+  /**
+   * 用 [data, data + bytes) 替换 body 的内容
+   * 使用 pool_allocator 时 vector 的 assign、insert 和拷贝构造会通过 allocator 逐个 byte 构造，走不到 std::allocator 的 memmove 快速路径，
+   * 4KiB 的 body 要慢几十倍，所以 body 之间的拷贝都用 resize 之后一次 memcpy
+   */
+  inline void assign_bytes(body_buffer &body, const uint8_t *data, size_t bytes)
+  {
+    body.resize(bytes);
+    if (bytes > 0)
+      std::memcpy(body.data(), data, bytes);
+  }
+}
@@ -3,11 +3,15 @@
 #include "asio.hpp"
 #include "net_message.hpp"
 #include "net_tsqueue.hpp"
+#include "net_lfqueue.hpp"
 #include "net_connection.hpp"
 #include "net_server.hpp"
+#include "net_log.hpp"
+#include <atomic>
+#include <chrono>
+#include <deque>
 #include <thread>
 #include <memory>
-#include <iostream>
 
 namespace net
 {
@@ -15,7 +19,7 @@ namespace net
   class client_interface
   {
   public:
-    client_interface() {};
+    client_interface() : m_udp(ctx) {};
     virtual ~client_interface()
     {
       DisConnect();
@@ -33,6 +37,20 @@ namespace net
 
         // 创建连接
         m_connection = std::make_unique<connection<T>>(connection<T>::owner::client, ctx, asio::ip::tcp::socket(ctx), message_in_dq);
+        if (m_compression)
+          m_connection->SetCompression(m_compression);
+
+        // 不可靠通道发往服务端同一个端口，取解析结果中的第一个地址
+        if (m_unreliable)
+        {
+          asio::ip::udp::resolver udpResolver(ctx);
+          asio::ip::udp::endpoint serverEndpoint = *udpResolver.resolve(host, std::to_string(port)).begin();
+          m_udp.Open(asio::ip::udp::endpoint(serverEndpoint.protocol(), 0), [this](const udp_header &header, message<T> &&msg, const asio::ip::udp::endpoint &from)
+                     {
+            if (m_connection && header.id == m_connection->GetID())
+              m_connection->ReceiveUnreliable(header.token, from, std::move(msg)); });
+          m_connection->SetUnreliableChannel(&m_udp, &serverEndpoint);
+        }
         m_connection->ConnectToServer(endpoints);
 
         // 开始异步操作
@@ -43,7 +61,7 @@ namespace net
       }
       catch (const std::exception &e)
       {
-        std::cerr << "Client Exception:" << e.what() << std::endl;
+        NET_LOG_ERROR("Client Exception:" << e.what());
         return false;
       }
     }
@@ -59,6 +77,16 @@ namespace net
       if (ctx_thread.joinable())
         ctx_thread.join();
 
+      StopWorker();
+
+      // 连接的异步操作占用的是连接自己的 handler_memory，释放连接之前要把剩下的操作都执行完，
+      // 否则 io_context 析构时会访问已经释放的内存：关闭 socket 后，未完成的读写会以 operation_aborted 完成
+      if (m_connection)
+      {
+        ctx.restart();
+        m_connection->DisConnect();
+        ctx.poll();
+      }
       m_connection.reset();
     };
 
@@ -76,19 +104,107 @@ namespace net
         m_connection->Send(msg);
     }
 
-    tsqueue<owned_message<T>> &InComing()
+    void Send(message<T> &&msg)
+    {
+      if (IsConnected())
+        m_connection->Send(std::move(msg));
+    }
+
+    // 开启不可靠通道（UDP），服务端也需要开启，需要在 Connect() 之前调用
+    void EnableUnreliableChannel()
+    {
+      m_unreliable = true;
+    }
+
+    // 通过不可靠通道发送，可能丢失、重复或者乱序，验证通过之前发送的会被服务端丢弃
+    void SendUnreliable(message<T> msg)
+    {
+      if (IsConnected())
+        m_connection->SendUnreliable(std::move(msg));
+    }
+
+    // 消息体不小于 minBytes 的该类型消息在发送前压缩，需要在 Connect() 之前调用
+    void SetCompressible(T id, size_t minBytes = 256)
+    {
+      auto rules = m_compression ? std::make_shared<compression_rules<T>>(*m_compression) : std::make_shared<compression_rules<T>>();
+      rules->Add(id, minBytes);
+      m_compression = std::move(rules);
+    }
+
+    inbound_queue<owned_message<T>> &InComing()
     {
       return message_in_dq;
     }
 
+    /**
+     * 最多等待 timeout，把接收队列中的消息一次取出最多 maxBatch 条，逐个调用 OnMessage，返回处理的消息个数
+     * 等待期间线程睡眠在条件变量上，不占用 CPU，超时返回 0
+     * 和 InComing() 一样只能由一个线程调用，开启 StartWorker() 之后不要再自己调用
+     */
+    size_t WaitAndProcess(std::chrono::steady_clock::duration timeout, size_t maxBatch = size_t(-1))
+    {
+      if (!message_in_dq.wait_for(timeout))
+        return 0;
+
+      message_in_dq.pop_front_batch(m_batch_dq, maxBatch);
+      size_t processed = 0;
+      while (!m_batch_dq.empty())
+      {
+        OnMessage(m_batch_dq.front().msg);
+        m_batch_dq.pop_front();
+        processed++;
+      }
+      return processed;
+    }
+
+    /**
+     * 启动后台线程循环调用 WaitAndProcess，收到的消息在该线程中进入 OnMessage
+     * pollInterval 是检查停止标记的间隔，只影响 StopWorker() 返回的快慢
+     */
+    void StartWorker(std::chrono::steady_clock::duration pollInterval = std::chrono::milliseconds(100))
+    {
+      if (worker_thread.joinable())
+        return;
+
+      m_worker_running = true;
+      worker_thread = std::thread([this, pollInterval]()
+                                  {
+        while (m_worker_running)
+          WaitAndProcess(pollInterval); });
+    }
+
+    /**
+     * 等待后台线程处理完当前这一批消息后退出，DisConnect() 和析构时会自动调用
+     * 子类的 OnMessage 用到子类自己的成员时，应该在子类的析构函数中先调用，否则后台线程可能访问已经析构的成员
+     */
+    void StopWorker()
+    {
+      m_worker_running = false;
+      if (worker_thread.joinable())
+        worker_thread.join();
+    }
+
   protected:
+    // WaitAndProcess 对每条消息的回调，开启 StartWorker() 时在后台线程中调用
+    virtual void OnMessage(const message<T> &msg)
+    {
+    }
+
     asio::io_context ctx;
     std::thread ctx_thread;
     std::unique_ptr<connection<T>> m_connection;
+    udp_channel<T> m_udp;
+    bool m_unreliable = false;
+    std::shared_ptr<const compression_rules<T>> m_compression;
+
+    std::thread worker_thread;
+    std::atomic<bool> m_worker_running{false};
+    // WaitAndProcess() 一次批量取出的消息，只在调用它的线程中访问
+    pooled_deque<owned_message<T>> m_batch_dq;
 
   private:
     // incoming message queue from server, and client need handle message in this queue
-    tsqueue<owned_message<T>> message_in_dq;
+    inbound_queue<owned_message<T>> message_in_dq;
   };
 
 }
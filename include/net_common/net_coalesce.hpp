@@ -0,0 +1,73 @@
+#pragma once
+
+#include "net_message.hpp"
+#include <functional>
+#include <unordered_map>
+#include <stddef.h>
+#include <stdint.h>
+
+namespace net
+{
+  /**
+   * 只关心最新值的消息类型（例如位置更新）
+   * 同一个连接的发送队列中，新消息会替换还没发送的、ID 和 key 都相同的旧消息，旧消息不会再发送
+   * - key 函数为空时，同一个 ID 只保留最新的一条
+   * - key 函数可以从消息中取出例如实体 ID，这样不同实体的更新不会互相替换
+   * key 函数在连接的 I/O 线程中调用，必须是线程安全的
+   */
+  template <typename T>
+  class coalesce_rules
+  {
+  public:
+    using key_function = std::function<uint64_t(const message<T> &)>;
+
+    void Add(T id, key_function key = nullptr)
+    {
+      rules[uint64_t(id)] = std::move(key);
+    }
+
+    void Remove(T id)
+    {
+      rules.erase(uint64_t(id));
+    }
+
+    // 消息是否可以合并，可以的话通过 key 返回合并用的 key
+    bool Match(const message<T> &msg, uint64_t &key) const
+    {
+      auto it = rules.find(uint64_t(msg.header.id));
+      if (it == rules.end())
+        return false;
+
+      key = it->second ? it->second(msg) : 0;
+      return true;
+    }
+
+    bool empty() const
+    {
+      return rules.empty();
+    }
+
+  private:
+    std::unordered_map<uint64_t, key_function> rules;
+  };
+
+  // 发送队列中可合并消息的索引 key
+  struct coalesce_key
+  {
+    uint64_t id = 0;
+    uint64_t key = 0;
+
+    bool operator==(const coalesce_key &other) const
+    {
+      return id == other.id && key == other.key;
+    }
+  };
+
+  struct coalesce_key_hash
+  {
+    size_t operator()(const coalesce_key &k) const
+    {
+      return std::hash<uint64_t>()(k.id * 0x9E3779B97F4A7C15ull ^ k.key);
+    }
+  };
+}
@@ -0,0 +1,219 @@
+#pragma once
+
+#include <cstring>
+#include <unordered_map>
+#include <stddef.h>
+#include <stdint.h>
+
+namespace net
+{
+  /**
+   * LZ4 block 格式的压缩/解压，只依赖标准库
+   * - 压缩使用单个 4 bytes 哈希表的贪心匹配，速度优先，压缩率略低于官方 LZ4 的默认级别
+   * - 解压会检查所有的长度和偏移，输入来自网络，格式错误时返回 false 而不会越界
+   */
+  class lz4_block
+  {
+  public:
+    // 压缩后最多可能的 bytes（数据完全不可压缩时）
+    static size_t Bound(size_t srcSize)
+    {
+      return srcSize + srcSize / 255 + 16;
+    }
+
+    // 返回压缩后的 bytes，dst 空间不够时返回 0
+    static size_t Compress(const uint8_t *src, size_t srcSize, uint8_t *dst, size_t dstCapacity)
+    {
+      uint32_t table[HashSize] = {};
+      size_t ip = 0;
+      size_t anchor = 0;
+      size_t op = 0;
+
+      // 格式要求：最后 5 bytes 必须是字面量，最后一个匹配必须在结尾 12 bytes 之前开始
+      if (srcSize > MinMatchStart)
+      {
+        size_t matchStartLimit = srcSize - MinMatchStart;
+        size_t matchEndLimit = srcSize - LastLiterals;
+        while (ip < matchStartLimit)
+        {
+          uint32_t sequence = Read32(src + ip);
+          uint32_t &slot = table[Hash(sequence)];
+          size_t candidate = slot;
+          slot = uint32_t(ip);
+
+          if (candidate < ip && ip - candidate <= MaxOffset && Read32(src + candidate) == sequence)
+          {
+            size_t matchBytes = MinMatch;
+            while (ip + matchBytes < matchEndLimit && src[candidate + matchBytes] == src[ip + matchBytes])
+              matchBytes++;
+
+            if (!WriteSequence(src + anchor, ip - anchor, ip - candidate, matchBytes, dst, dstCapacity, op))
+              return 0;
+
+            ip += matchBytes;
+            anchor = ip;
+            continue;
+          }
+
+          // 长时间找不到匹配时加快步进，不可压缩的数据也能很快跳过
+          ip += 1 + ((ip - anchor) >> 6);
+        }
+      }
+
+      // 剩下的都是字面量
+      if (!WriteSequence(src + anchor, srcSize - anchor, 0, 0, dst, dstCapacity, op))
+        return 0;
+      return op;
+    }
+
+    // 解压到 dst，解压后必须正好是 dstSize bytes
+    static bool Decompress(const uint8_t *src, size_t srcSize, uint8_t *dst, size_t dstSize)
+    {
+      size_t ip = 0;
+      size_t op = 0;
+      while (ip < srcSize)
+      {
+        uint8_t token = src[ip++];
+
+        size_t literals = token >> 4;
+        if (literals == 15 && !ReadLength(src, srcSize, ip, literals))
+          return false;
+        if (literals > srcSize - ip || literals > dstSize - op)
+          return false;
+
+        if (literals > 0)
+          std::memcpy(dst + op, src + ip, literals);
+        ip += literals;
+        op += literals;
+
+        // 最后一个序列只有字面量
+        if (ip == srcSize)
+          break;
+
+        if (srcSize - ip < 2)
+          return false;
+        size_t offset = size_t(src[ip]) | size_t(src[ip + 1]) << 8;
+        ip += 2;
+        if (offset == 0 || offset > op)
+          return false;
+
+        size_t matchBytes = token & 15;
+        if (matchBytes == 15 && !ReadLength(src, srcSize, ip, matchBytes))
+          return false;
+        matchBytes += MinMatch;
+        if (matchBytes > dstSize - op)
+          return false;
+
+        // 偏移小于长度时源和目标重叠，需要逐 byte 复制
+        uint8_t *out = dst + op;
+        const uint8_t *match = out - offset;
+        if (offset >= matchBytes)
+          std::memcpy(out, match, matchBytes);
+        else
+          for (size_t i = 0; i < matchBytes; i++)
+            out[i] = match[i];
+        op += matchBytes;
+      }
+      return op == dstSize;
+    }
+
+  private:
+    static constexpr size_t HashLog = 12;
+    static constexpr size_t HashSize = size_t(1) << HashLog;
+    static constexpr size_t MinMatch = 4;
+    static constexpr size_t LastLiterals = 5;
+    static constexpr size_t MinMatchStart = 12;
+    static constexpr size_t MaxOffset = 65535;
+
+    static uint32_t Read32(const uint8_t *p)
+    {
+      uint32_t v;
+      std::memcpy(&v, p, sizeof(v));
+      return v;
+    }
+
+    static size_t Hash(uint32_t sequence)
+    {
+      return size_t((sequence * 2654435761u) >> (32 - HashLog));
+    }
+
+    static void WriteLength(size_t length, uint8_t *dst, size_t &op)
+    {
+      while (length >= 255)
+      {
+        dst[op++] = 255;
+        length -= 255;
+      }
+      dst[op++] = uint8_t(length);
+    }
+
+    // 长度字段超过 15 时，后面跟着若干个 byte，直到不是 255 为止
+    static bool ReadLength(const uint8_t *src, size_t srcSize, size_t &ip, size_t &length)
+    {
+      uint8_t b;
+      do
+      {
+        if (ip >= srcSize)
+          return false;
+        b = src[ip++];
+        length += b;
+      } while (b == 255);
+      return true;
+    }
+
+    // 写入一个序列：字面量 + 匹配，matchBytes 为 0 表示最后一个只有字面量的序列
+    static bool WriteSequence(const uint8_t *literals, size_t literalBytes, size_t offset, size_t matchBytes, uint8_t *dst, size_t dstCapacity, size_t &op)
+    {
+      size_t need = 1 + literalBytes / 255 + 1 + literalBytes + 2 + matchBytes / 255 + 1;
+      if (need > dstCapacity - op)
+        return false;
+
+      uint8_t &token = dst[op++];
+      token = uint8_t((literalBytes >= 15 ? 15 : literalBytes) << 4);
+      if (literalBytes >= 15)
+        WriteLength(literalBytes - 15, dst, op);
+      if (literalBytes > 0)
+        std::memcpy(dst + op, literals, literalBytes);
+      op += literalBytes;
+
+      if (matchBytes == 0)
+        return true;
+
+      dst[op++] = uint8_t(offset);
+      dst[op++] = uint8_t(offset >> 8);
+      size_t matchLength = matchBytes - MinMatch;
+      token |= uint8_t(matchLength >= 15 ? 15 : matchLength);
+      if (matchLength >= 15)
+        WriteLength(matchLength - 15, dst, op);
+      return true;
+    }
+  };
+
+  /**
+   * 需要压缩的消息类型，以及消息体至少多少 bytes 才压缩（太小的消息压缩收益低于 CPU 开销）
+   */
+  template <typename T>
+  class compression_rules
+  {
+  public:
+    void Add(T id, size_t minBytes)
+    {
+      rules[uint64_t(id)] = minBytes;
+    }
+
+    void Remove(T id)
+    {
+      rules.erase(uint64_t(id));
+    }
+
+    // 该类型、该大小的消息是否需要压缩
+    bool Match(T id, size_t bodyBytes) const
+    {
+      auto it = rules.find(uint64_t(id));
+      return it != rules.end() && bodyBytes >= it->second;
+    }
+
+  private:
+    std::unordered_map<uint64_t, size_t> rules;
+  };
+}
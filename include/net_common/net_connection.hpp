@@ -2,8 +2,18 @@
 
 #include "net_message.hpp"
 #include "net_tsqueue.hpp"
+#include "net_lfqueue.hpp"
+#include "net_metrics.hpp"
+#include "net_coalesce.hpp"
+#include "net_compress.hpp"
+#include "net_udp.hpp"
+#include "net_log.hpp"
+#include "net_handler_memory.hpp"
 #include "asio.hpp"
-#include <iostream>
+#include <functional>
+#include <deque>
+#include <array>
+#include <unordered_map>
 
 namespace net
 {
@@ -11,6 +21,60 @@ namespace net
   template <typename T>
   class server_interface;
 
+  /**
+   * 发送队列超过高水位时的处理策略
+   */
+  enum class backpressure_policy
+  {
+    // 只通知，继续排队
+    none,
+    // 丢弃队列中最早的消息（正在发送的除外），直到低于高水位
+    drop_oldest,
+    // 丢弃新的消息
+    drop_newest,
+    // 用新消息替换队列中 ID 相同的旧消息，没有相同 ID 的消息时继续排队
+    coalesce,
+    // 断开连接
+    disconnect,
+  };
+
+  /**
+   * 发送队列的水位设置，值为 0 表示不限制
+   * 超过任意一个高水位即为拥塞，bytes 和消息数都回到低水位以下才解除拥塞，低水位为 0 时取高水位的一半
+   */
+  struct backpressure_config
+  {
+    size_t highWaterBytes = 0;
+    size_t lowWaterBytes = 0;
+    size_t highWaterMessages = 0;
+    size_t lowWaterMessages = 0;
+    backpressure_policy policy = backpressure_policy::none;
+  };
+
+  /**
+   * 一段 const_buffer 数组的只读视图，作为 async_write 的 buffer 序列
+   * asio 会按值保存 buffer 序列，直接传 std::vector 每次发送都要复制一份（申请内存），这里只复制两个指针
+   * 数组在写完之前必须保持有效
+   */
+  struct const_buffer_view
+  {
+    using value_type = asio::const_buffer;
+    using const_iterator = const asio::const_buffer *;
+
+    const asio::const_buffer *first = nullptr;
+    const asio::const_buffer *last = nullptr;
+
+    const_iterator begin() const
+    {
+      return first;
+    }
+
+    const_iterator end() const
+    {
+      return last;
+    }
+  };
+
   /**
    * 用来控制 p2p data transfer，全部都是异步操作
    * 创建时机：
@@ -36,17 +100,35 @@ namespace net
     asio::io_context &ctx;
 
     // This queue holds all messages to be sent to the remote side of this connection
-    // 确保顺序发送
-    tsqueue<message<T>> message_out_dq;
+    // 确保顺序发送，只在 ctx 线程中访问（Send 会先 post 过去），所以不需要加锁
+    // 队列的节点从 buffer_pool 分配，稳定运行后不再向系统申请内存
+    pooled_deque<outgoing_message<T>> message_out_dq;
+    // message_out_dq 中消息的总 bytes（包括消息头），正在发送的消息不算
+    size_t outQueuedBytes = 0;
+
+    // 发送队列的水位和超过高水位时的策略
+    backpressure_config backpressure;
+    // 是否处于拥塞状态，进入和解除时各通知服务端一次
+    bool congested = false;
+
+    // 只关心最新值的消息类型，多个连接共享同一份规则
+    std::shared_ptr<const coalesce_rules<T>> coalesce;
+    // 发送队列中可合并消息的位置，值为消息的序号，序号减去 outFrontSeq 即为在 message_out_dq 中的下标
+    std::unordered_map<coalesce_key, uint64_t, coalesce_key_hash> coalesceIndex;
+    // message_out_dq.front() 的序号，每取出一条消息加一
+    uint64_t outFrontSeq = 0;
+
+    // 需要压缩的消息类型，多个连接共享同一份规则，为空时不压缩（收到的压缩消息总是会解压）
+    std::shared_ptr<const compression_rules<T>> compression;
 
     // This references the incoming queue of the owner of connection, we will push received message into this queue
-    tsqueue<owned_message<T>> &message_in_dq;
+    inbound_queue<owned_message<T>> &message_in_dq;
 
     // The "owner" decides how some of the connection behaves
     owner ownerType;
 
     // 连接的唯一 ID
-    uint32_t id;
+    uint32_t id = 0;
 
     // 连接的验证码，可以一段时间更新一次，不要每个请求都去更新，太耗时了
 
@@ -59,6 +141,45 @@ namespace net
 
     message<T> tempMsg;
 
+    // 服务端的连接才有，读写失败时通知服务端移除该连接
+    server_interface<T> *server = nullptr;
+    // 是否已经通知过服务端，只在 ctx 线程中访问
+    bool closeNotified = false;
+
+    // 连接的计数器，可以在其他线程中读取
+    connection_metrics metrics;
+
+    // 收到新消息或者连接关闭时在 ctx 线程中调用，例如唤醒等待消息的协程
+    std::function<void()> onNotify;
+
+    // 不可靠通道（UDP），为空时 SendUnreliable 直接丢弃
+    udp_channel<T> *udp = nullptr;
+    // 对端的 UDP 地址，只在 udp 通道的线程中访问；服务端的连接收到第一个合法的数据报后才知道
+    asio::ip::udp::endpoint udpEndpoint;
+    bool udpEndpointKnown = false;
+
+    // 正在发送的一批消息，发送完成前必须保证这些内存有效；批变大时扩容的内存也来自 buffer_pool
+    std::vector<outgoing_message<T>, pool_allocator<outgoing_message<T>>> writingMsgs;
+    std::vector<asio::const_buffer, pool_allocator<asio::const_buffer>> writeBuffers;
+    // 接收缓冲区，每次 async_read_some 读到这里，再从中解析出所有完整的报文
+    std::vector<uint8_t> readBuffer;
+    // 缓冲区中有效数据的结尾，[0, readEnd) 是还没有解析的数据
+    size_t readEnd = 0;
+    size_t readBufferBytes = 64 * 1024;
+
+    // 异步操作回调的内存，读（含 connect）和写各自同一时间最多只有一个操作；post 可能由多个线程同时发起，多准备几块
+    // gather write 的操作对象最大，大约 500 bytes
+    handler_memory<256> readHandlerMemory;
+    handler_memory<512> writeHandlerMemory;
+    handler_memory<160, 8> postHandlerMemory;
+
+    // 是否有正在进行的 async_write，只在 ctx 线程中访问
+    bool isWriting = false;
+    // 验证码是否已经写入 socket，之前 Send 的消息（例如 OnClientConnect 中发送的）先留在发送队列中，只在 ctx 线程中访问
+    bool validationWritten = false;
+    // 一次 gather write 最多合并多少 bytes 的消息
+    size_t writeBatchBytes = 64 * 1024;
+
   private:
     // "Encrypt" Validation data
     uint64_t scramble(uint64_t nInput)
@@ -85,9 +206,36 @@ namespace net
       }
     }
 
-    void ReadValidation(server_interface<T> *server = nullptr)
+    /**
+     * 异步回调中持有连接自己的引用，保证回调执行之前连接不会被释放（服务端移除连接时可能还有回调没执行）
+     * 客户端的连接由 unique_ptr 管理，这里返回 nullptr，由 client_interface 保证先停止 io_context 再释放连接
+     */
+    std::shared_ptr<connection<T>> KeepAlive()
+    {
+      return this->weak_from_this().lock();
+    }
+
+    // 读写失败或验证失败时关闭连接，并立刻通知服务端移除该连接，只会通知一次
+    void Close()
     {
-      asio::async_read(socket, asio::buffer(&response, sizeof(uint64_t)), [this, server](std::error_code ec, std::size_t length)
+      if (socket.is_open())
+        socket.close();
+
+      if (onNotify)
+        onNotify();
+
+      if (server != nullptr && !closeNotified)
+      {
+        closeNotified = true;
+        server->OnConnectionClosed(this->shared_from_this());
+      }
+    }
+
+    void ReadValidation()
+    {
+      // 客户端同时读取服务端分配的连接 ID，不可靠通道的数据报需要带上它
+      std::array<asio::mutable_buffer, 2> buffers{asio::buffer(&response, sizeof(uint64_t)), asio::buffer(&id, ownerType == owner::client ? sizeof(uint32_t) : 0)};
+      asio::async_read(socket, buffers, bind_handler_memory(readHandlerMemory, [this, self = KeepAlive()](std::error_code ec, std::size_t length)
                        {
         if (!ec) {
           if (ownerType == owner::client) {
@@ -95,123 +243,447 @@ namespace net
             WriteValidation();
           } else {
             if (response == exceptResponseValidation) {
-              std::cout << "[" << id << "] Validation OK" << std::endl;
+              NET_LOG_INFO("[" << id << "] Validation OK");
               server->OnClientValidated(this->shared_from_this());
-              ReadHeader();
+              ReadFrames();
             } else {
-              std::cout << "[" << id << "] Validation Failed, Close" << std::endl;
-              socket.close();
+              NET_LOG_WARN("[" << id << "] Validation Failed, Close");
+              metrics.handshakeFailures++;
+              Close();
             }
           }
         } else {
-          std::cout << "[" << id << "] Read Validation Failed" << std::endl;
-          socket.close();
-        } });
+          NET_LOG_WARN("[" << id << "] Read Validation Failed");
+          metrics.handshakeFailures++;
+          Close();
+        } }));
     }
 
     void WriteValidation()
     {
-      asio::async_write(socket, asio::buffer(&validation, sizeof(uint64_t)), [this](std::error_code ec, std::size_t length)
+      std::array<asio::const_buffer, 2> buffers{asio::buffer(&validation, sizeof(uint64_t)), asio::buffer(&id, ownerType == owner::server ? sizeof(uint32_t) : 0)};
+      asio::async_write(socket, buffers, bind_handler_memory(writeHandlerMemory, [this, self = KeepAlive()](std::error_code ec, std::size_t length)
                         {
         if (!ec) {
           if(ownerType == owner::client)
-            ReadHeader();
+            ReadFrames();
+
+          // 握手期间 Send 的消息只放进了发送队列，现在开始发送
+          validationWritten = true;
+          if (!message_out_dq.empty())
+            WriteMessages();
         } else {
-          std::cout << "[" << id << "] Write Validation Failed" << std::endl;
-          socket.close();
-        } });
+          NET_LOG_WARN("[" << id << "] Write Validation Failed");
+          metrics.handshakeFailures++;
+          Close();
+        } }));
     }
 
-    void WriteHeader()
+    void WriteMessages()
     {
-      asio::async_write(socket, asio::buffer(&message_out_dq.front().header, sizeof(message_header<T>)), [this](std::error_code ec, std::size_t length)
-                        {
-        if (!ec) {
-          if (message_out_dq.front().body.size() > 0)
-          {
-            // 有 body
-            WriteBody();
-          }
-          else
-          {
-            // 无 body，写完毕
-            message_out_dq.pop_front();
-            if (!message_out_dq.empty()) WriteHeader();
-          }
-        } else {
-          std::cout << "[" << id << "] Write Header Failed" << std::endl;
-          socket.close();
-        } });
-    };
+      // 从发送队列中取出尽可能多的消息（总 bytes 不超过 writeBatchBytes，但至少取一条）
+      writingMsgs.clear();
+      size_t batchBytes = 0;
+      while (!message_out_dq.empty())
+      {
+        size_t msgBytes = OutgoingBytes(message_out_dq.front());
+        if (!writingMsgs.empty() && batchBytes + msgBytes > writeBatchBytes)
+          break;
+
+        writingMsgs.emplace_back(PopOutgoing());
+        if (compression)
+          CompressOutgoing(writingMsgs.back());
+        batchBytes += msgBytes;
+      }
 
-    void WriteBody()
-    {
-      asio::async_write(socket, asio::buffer(message_out_dq.front().body.data(), message_out_dq.front().body.size()), [this](std::error_code ec, std::size_t length)
+      if (congested && IsBelowLowWater())
+        SetCongested(false);
+
+      // 所有消息都取出后再生成 buffer，避免 writingMsgs 扩容导致 buffer 指向失效的内存
+      writeBuffers.clear();
+      for (auto &outgoing : writingMsgs)
+      {
+        const message<T> &msg = outgoing.get();
+        writeBuffers.emplace_back(asio::buffer(&msg.header, sizeof(message_header<T>)));
+        if (msg.body.size() > 0)
+          writeBuffers.emplace_back(asio::buffer(msg.body.data(), msg.body.size()));
+      }
+
+      isWriting = true;
+      // 所有 header 和 body 组成一个 buffer 序列，一次 gather write 发送出去
+      const_buffer_view buffers{writeBuffers.data(), writeBuffers.data() + writeBuffers.size()};
+      asio::async_write(socket, buffers, bind_handler_memory(writeHandlerMemory, [this, self = KeepAlive()](std::error_code ec, std::size_t length)
                         {
         if (!ec) {
-          message_out_dq.pop_front();
+          isWriting = false;
+          RecordWritten(length);
           if (!message_out_dq.empty())
-            WriteHeader();
+            WriteMessages();
         } else {
-          std::cout << "[" << id << "] Write Body Failed" << std::endl;
-          socket.close();
-        } });
+          NET_LOG_WARN("[" << id << "] Write Messages Failed");
+          metrics.writeErrors++;
+          Close();
+        } }));
     };
 
-    void ReadHeader()
+    static size_t OutgoingBytes(const outgoing_message<T> &outgoing)
     {
-      asio::async_read(socket, asio::buffer(&tempMsg.header, sizeof(message_header<T>)), [this](std::error_code ec, std::size_t length)
+      return sizeof(message_header<T>) + outgoing.get().body.size();
+    }
+
+    // 再加入 extraBytes bytes、extraMessages 条消息后是否超过高水位
+    bool IsAboveHighWater(size_t extraBytes, size_t extraMessages) const
+    {
+      return (backpressure.highWaterBytes > 0 && outQueuedBytes + extraBytes > backpressure.highWaterBytes) ||
+             (backpressure.highWaterMessages > 0 && message_out_dq.size() + extraMessages > backpressure.highWaterMessages);
+    }
+
+    bool IsBelowLowWater() const
+    {
+      size_t lowBytes = backpressure.lowWaterBytes > 0 ? backpressure.lowWaterBytes : backpressure.highWaterBytes / 2;
+      size_t lowMessages = backpressure.lowWaterMessages > 0 ? backpressure.lowWaterMessages : backpressure.highWaterMessages / 2;
+      return (backpressure.highWaterBytes == 0 || outQueuedBytes <= lowBytes) &&
+             (backpressure.highWaterMessages == 0 || message_out_dq.size() <= lowMessages);
+    }
+
+    void SetCongested(bool isCongested)
+    {
+      congested = isCongested;
+      if (server != nullptr)
+        server->OnBackpressure(this->shared_from_this(), congested);
+    }
+
+    // 压缩 raw，压缩后没有变小时返回 false
+    static bool CompressMessage(const message<T> &raw, message<T> &compressed)
+    {
+      size_t rawBytes = raw.body.size();
+      compressed.header = raw.header;
+      compressed.body.resize(sizeof(uint32_t) + lz4_block::Bound(rawBytes));
+      uint32_t rawSize = uint32_t(rawBytes);
+      std::memcpy(compressed.body.data(), &rawSize, sizeof(uint32_t));
+      size_t compressedBytes = lz4_block::Compress(raw.body.data(), rawBytes, compressed.body.data() + sizeof(uint32_t), compressed.body.size() - sizeof(uint32_t));
+
+      if (compressedBytes == 0 || sizeof(uint32_t) + compressedBytes >= rawBytes)
+        return false;
+
+      compressed.body.resize(sizeof(uint32_t) + compressedBytes);
+      compressed.header.size = uint32_t(compressed.body.size()) | message_header<T>::CompressedFlag;
+      return true;
+    }
+
+    /**
+     * 按规则压缩即将写入 socket 的消息，压缩后的消息体为：原始大小（uint32_t）+ LZ4 block
+     * 放在写入前而不是 Send 时压缩，被合并或者丢弃的消息不会浪费 CPU
+     * 带有 sharedCompression 的广播消息只在第一个写到它的连接上压缩一次，其余连接共用结果
+     */
+    void CompressOutgoing(outgoing_message<T> &outgoing)
+    {
+      const message<T> &raw = outgoing.get();
+      size_t rawBytes = raw.body.size();
+      if (rawBytes >= message_header<T>::CompressedFlag || !compression->Match(raw.header.id, rawBytes))
+        return;
+
+      if (outgoing.shared && outgoing.sharedCompression)
+      {
+        shared_compression<T> &cache = *outgoing.sharedCompression;
+        std::call_once(cache.once, [&]()
                        {
-        if (!ec) {
-          if (tempMsg.header.size > 0)
+          message<T> compressed;
+          if (CompressMessage(raw, compressed))
+            cache.compressed = std::make_shared<const message<T>>(std::move(compressed)); });
+
+        // 压缩后没有变小就发送原始消息
+        if (cache.compressed)
+          outgoing.shared = cache.compressed;
+        outgoing.sharedCompression = nullptr;
+        return;
+      }
+
+      // 压缩后没有变小就发送原始消息
+      message<T> compressed;
+      if (!CompressMessage(raw, compressed))
+        return;
+
+      outgoing.msg = std::move(compressed);
+      outgoing.shared = nullptr;
+    }
+
+    // 消息离开发送队列时，删除它在 coalesceIndex 中的位置（如果有）
+    void UnindexOutgoing(const outgoing_message<T> &outgoing, uint64_t seq)
+    {
+      if (!outgoing.coalescable)
+        return;
+
+      auto found = coalesceIndex.find(coalesce_key{uint64_t(outgoing.get().header.id), outgoing.coalesceKey});
+      if (found != coalesceIndex.end() && found->second == seq)
+        coalesceIndex.erase(found);
+    }
+
+    // 取出发送队列的第一条消息
+    outgoing_message<T> PopOutgoing()
+    {
+      outgoing_message<T> outgoing = std::move(message_out_dq.front());
+      message_out_dq.pop_front();
+      outQueuedBytes -= OutgoingBytes(outgoing);
+      UnindexOutgoing(outgoing, outFrontSeq);
+      outFrontSeq++;
+      return outgoing;
+    }
+
+    // 丢弃一条还没发送的消息
+    void DropOutgoing()
+    {
+      metrics.messagesDropped.fetch_add(1, std::memory_order_relaxed);
+      metrics.outQueueDepth.fetch_sub(1, std::memory_order_relaxed);
+    }
+
+    // 在 ctx 线程中把消息放入发送队列，超过高水位时按照策略处理
+    void EnqueueOutgoing(outgoing_message<T> &&outgoing)
+    {
+      size_t msgBytes = OutgoingBytes(outgoing);
+
+      // 只关心最新值的消息，替换队列中还没发送的旧消息，不会增加队列长度
+      if (coalesce && coalesce->Match(outgoing.get(), outgoing.coalesceKey))
+      {
+        outgoing.coalescable = true;
+        coalesce_key key{uint64_t(outgoing.get().header.id), outgoing.coalesceKey};
+        auto found = coalesceIndex.find(key);
+        if (found != coalesceIndex.end())
+        {
+          outgoing_message<T> &queued = message_out_dq[size_t(found->second - outFrontSeq)];
+          outQueuedBytes = outQueuedBytes - OutgoingBytes(queued) + msgBytes;
+          queued = std::move(outgoing);
+          metrics.messagesCoalesced.fetch_add(1, std::memory_order_relaxed);
+          metrics.outQueueDepth.fetch_sub(1, std::memory_order_relaxed);
+          return;
+        }
+        coalesceIndex.emplace(key, outFrontSeq + message_out_dq.size());
+      }
+
+      if (IsAboveHighWater(msgBytes, 1))
+      {
+        if (!congested)
+          SetCongested(true);
+
+        switch (backpressure.policy)
+        {
+        case backpressure_policy::drop_newest:
+          UnindexOutgoing(outgoing, outFrontSeq + message_out_dq.size());
+          DropOutgoing();
+          return;
+        case backpressure_policy::drop_oldest:
+          while (!message_out_dq.empty() && IsAboveHighWater(msgBytes, 1))
           {
-            // 有 body
-            tempMsg.body.resize(tempMsg.header.size);
-            ReadBody();
+            PopOutgoing();
+            DropOutgoing();
           }
-          else
+          break;
+        case backpressure_policy::coalesce:
+          // 从后往前找 ID 相同的旧消息，找到就原地替换，新消息会占用旧消息在队列中的位置
+          // 按 key 合并的消息已经在上面处理过，这里不能忽略 key 去替换
+          if (outgoing.coalescable)
+            break;
+          for (auto it = message_out_dq.rbegin(); it != message_out_dq.rend(); ++it)
           {
-            // 无 body
-            AddTempMsgToQueue();
+            if (!it->coalescable && it->get().header.id == outgoing.get().header.id)
+            {
+              outQueuedBytes = outQueuedBytes - OutgoingBytes(*it) + msgBytes;
+              *it = std::move(outgoing);
+              DropOutgoing();
+              return;
+            }
           }
+          break;
+        case backpressure_policy::disconnect:
+          NET_LOG_WARN("[" << id << "] Send Queue Overflow, Close");
+          UnindexOutgoing(outgoing, outFrontSeq + message_out_dq.size());
+          DropOutgoing();
+          Close();
+          return;
+        case backpressure_policy::none:
+          break;
+        }
+      }
+
+      // 往 out mesaage queue 添加要发送的消息
+      message_out_dq.emplace_back(std::move(outgoing));
+      outQueuedBytes += msgBytes;
+
+      // 如果当前没有正在进行的发送任务，需要唤起任务
+      // 否则，发送任务完成后会继续把队列中的消息一起发送出去，不需要再次启动
+      // 验证码写完之前只入队，否则消息会和验证码交错写入 socket
+      if (!isWriting && validationWritten)
+        WriteMessages();
+    }
+
+    // 一批消息写入完成，更新计数，服务端的连接还要统计消息在发送队列中等待的时间
+    void RecordWritten(size_t length)
+    {
+      metrics.bytesOut.fetch_add(length, std::memory_order_relaxed);
+      metrics.messagesOut.fetch_add(writingMsgs.size(), std::memory_order_relaxed);
+      metrics.outQueueDepth.fetch_sub(writingMsgs.size(), std::memory_order_relaxed);
+
+      if (server != nullptr)
+      {
+        auto now = std::chrono::steady_clock::now();
+        for (auto &outgoing : writingMsgs)
+        {
+          server->Metrics().outQueueTime.Record(uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(now - outgoing.enqueued).count()));
+          server->Metrics().messagesOutByType.Increment(outgoing.get().header.id);
+        }
+      }
+    }
+
+    void ReadFrames()
+    {
+      if (readBuffer.empty())
+        readBuffer.resize(readBufferBytes);
+
+      // 一次尽可能多地读取数据，接在上次没有解析完的半个报文后面
+      socket.async_read_some(asio::buffer(readBuffer.data() + readEnd, readBuffer.size() - readEnd), bind_handler_memory(readHandlerMemory, [this, self = KeepAlive()](std::error_code ec, std::size_t length)
+                             {
+        if (!ec) {
+          metrics.bytesIn.fetch_add(length, std::memory_order_relaxed);
+          readEnd += length;
+          ParseFrames();
         } else {
-          std::cout << "[" << id << "] Read Header Failed" << std::endl;
-          // 这里可以调用离线，这样不用发消息时才确定离线，读取 Header 失败，一定是离线导致吗？
-          socket.close();
-        } });
+          NET_LOG_INFO("[" << id << "] Read Frames Failed");
+          metrics.readErrors++;
+          // 读取失败说明对端断开或者连接被关闭，立刻通知服务端移除该连接
+          Close();
+        } }));
+    };
+
+    // 从接收缓冲区中解析出所有完整的报文，剩下的半个报文移动到缓冲区头部，等下次读取再拼接
+    void ParseFrames()
+    {
+      // 同一次读取的报文使用同一个接收时间
+      auto received = std::chrono::steady_clock::now();
+      size_t pos = 0;
+      while (readEnd - pos >= sizeof(message_header<T>))
+      {
+        message_header<T> header;
+        std::memcpy(&header, readBuffer.data() + pos, sizeof(message_header<T>));
+
+        size_t bodyBytes = header.size & ~message_header<T>::CompressedFlag;
+        size_t frameBytes = sizeof(message_header<T>) + bodyBytes;
+        if (frameBytes > readBuffer.size())
+        {
+          // 报文比整个接收缓冲区还大，已经收到的部分拷贝到 tempMsg 中，剩余的 body 直接读到 tempMsg 里
+          size_t bodyReceived = readEnd - pos - sizeof(message_header<T>);
+          tempMsg.header = header;
+          tempMsg.body.resize(bodyBytes);
+          std::memcpy(tempMsg.body.data(), readBuffer.data() + pos + sizeof(message_header<T>), bodyReceived);
+          readEnd = 0;
+          ReadBody(bodyReceived);
+          return;
+        }
+
+        if (readEnd - pos < frameBytes)
+          break;
+
+        // 一个完整报文
+        tempMsg.header = header;
+        assign_bytes(tempMsg.body, readBuffer.data() + pos + sizeof(message_header<T>), bodyBytes);
+        if (!DecompressTempMsg())
+          return;
+        AddTempMsgToQueue(received);
+        pos += frameBytes;
+      }
+
+      // 剩下不完整的报文，移动到缓冲区头部
+      if (pos > 0)
+      {
+        std::memmove(readBuffer.data(), readBuffer.data() + pos, readEnd - pos);
+        readEnd -= pos;
+      }
+
+      // 继续读
+      ReadFrames();
     };
 
-    void ReadBody()
+    // 只用于大于接收缓冲区的报文，received 为已经拷贝到 tempMsg.body 中的 bytes
+    void ReadBody(size_t received)
     {
-      asio::async_read(socket, asio::buffer(tempMsg.body.data(), tempMsg.body.size()), [this](std::error_code ec, std::size_t length)
+      asio::async_read(socket, asio::buffer(tempMsg.body.data() + received, tempMsg.body.size() - received), bind_handler_memory(readHandlerMemory, [this, self = KeepAlive()](std::error_code ec, std::size_t length)
                        {
         if (!ec) {
-          AddTempMsgToQueue();
+          metrics.bytesIn.fetch_add(length, std::memory_order_relaxed);
+          if (!DecompressTempMsg())
+            return;
+          AddTempMsgToQueue(std::chrono::steady_clock::now());
+          ReadFrames();
         } else {
-          std::cout << "[" << id << "] Read Body Failed" << std::endl;
-          socket.close();
-        } });
+          NET_LOG_INFO("[" << id << "] Read Body Failed");
+          metrics.readErrors++;
+          Close();
+        } }));
     };
 
-    void AddTempMsgToQueue()
+    // 如果 tempMsg 是压缩过的，解压还原成原始消息，数据格式错误时关闭连接并返回 false
+    bool DecompressTempMsg()
+    {
+      if (!(tempMsg.header.size & message_header<T>::CompressedFlag))
+        return true;
+
+      bool ok = tempMsg.body.size() >= sizeof(uint32_t);
+      uint32_t rawSize = 0;
+      size_t compressedBytes = 0;
+      if (ok)
+      {
+        std::memcpy(&rawSize, tempMsg.body.data(), sizeof(uint32_t));
+        compressedBytes = tempMsg.body.size() - sizeof(uint32_t);
+        // LZ4 的压缩率不会超过 255 倍，超过说明数据有问题，避免按伪造的大小分配内存
+        ok = rawSize < message_header<T>::CompressedFlag && rawSize <= compressedBytes * 255 + 16;
+      }
+
+      body_buffer raw;
+      if (ok)
+      {
+        raw.resize(rawSize);
+        ok = lz4_block::Decompress(tempMsg.body.data() + sizeof(uint32_t), compressedBytes, raw.data(), rawSize);
+      }
+
+      if (!ok)
+      {
+        NET_LOG_WARN("[" << id << "] Decompress Failed, Close");
+        metrics.readErrors++;
+        Close();
+        return false;
+      }
+
+      tempMsg.body.swap(raw);
+      tempMsg.header.size = rawSize;
+      return true;
+    }
+
+    void AddTempMsgToQueue(std::chrono::steady_clock::time_point received)
     {
       // 一个完整报文读取完毕
       /**
        * 如果是 owner::client，说明 connection 是客户端向服务端发起请求时创建的
-       * 并且是从 ConnectToServer 中的 ReadHeader 到这里，意味着数据来自服务端，这个 connection 不需要保存
+       * 并且是从 ConnectToServer 中的 ReadFrames 到这里，意味着数据来自服务端，这个 connection 不需要保存
        *
        *
        * 反之，说明 connection 是服务端接收到客户端发起请求时创建的，那么需要保存下来，方便服务端向该请求的客户端发送响应
        **/
       auto message_owner = ownerType == owner::client ? nullptr : this->shared_from_this();
-      message_in_dq.emplace_back({message_owner, std::move(tempMsg)});
+      metrics.messagesIn.fetch_add(1, std::memory_order_relaxed);
+      // 服务端可以在 I/O 线程中直接处理，不进入接收队列，见 server_interface::OnIOMessage
+      if (server != nullptr && server->OnIOMessage(message_owner, tempMsg))
+      {
+        server->Metrics().messagesInByType.Increment(tempMsg.header.id);
+        return;
+      }
 
-      // 继续读
-      ReadHeader();
+      message_in_dq.emplace_back({message_owner, std::move(tempMsg), received});
+
+      if (onNotify)
+        onNotify();
     }
 
   public:
-    connection(owner ownerType, asio::io_context &ctx, asio::ip::tcp::socket socket, tsqueue<owned_message<T>> &qIn) : ownerType(ownerType), ctx(ctx), socket(std::move(socket)), message_in_dq(qIn)
+    connection(owner ownerType, asio::io_context &ctx, asio::ip::tcp::socket socket, inbound_queue<owned_message<T>> &qIn) : ownerType(ownerType), ctx(ctx), socket(std::move(socket)), message_in_dq(qIn)
     {
       UpdateValidation();
     };
@@ -219,6 +691,51 @@ namespace net
 
     uint32_t GetID() const { return id; }
 
+    // 连接计数的快照，可以在任意线程中调用
+    connection_metrics_snapshot GetMetrics() const
+    {
+      connection_metrics_snapshot s = metrics.Snapshot();
+      s.id = id;
+      return s;
+    }
+
+    // 设置收到新消息或者连接关闭时的通知，必须在 ctx 线程中调用
+    void SetNotify(std::function<void()> notify)
+    {
+      onNotify = std::move(notify);
+    }
+
+    // 设置发送队列的水位和策略
+    void SetBackpressure(const backpressure_config &config)
+    {
+      asio::post(ctx, bind_handler_memory(postHandlerMemory, [this, self = KeepAlive(), config]()
+                 { backpressure = config; }));
+    }
+
+    // 设置只关心最新值的消息类型，传入 nullptr 取消
+    void SetCoalescing(std::shared_ptr<const coalesce_rules<T>> rules)
+    {
+      asio::post(ctx, bind_handler_memory(postHandlerMemory, [this, self = KeepAlive(), rules = std::move(rules)]() mutable
+                 {
+        coalesce = std::move(rules);
+        // 队列中已有的消息不再参与合并
+        coalesceIndex.clear(); }));
+    }
+
+    // 设置需要压缩的消息类型，传入 nullptr 不再压缩
+    void SetCompression(std::shared_ptr<const compression_rules<T>> rules)
+    {
+      asio::post(ctx, bind_handler_memory(postHandlerMemory, [this, self = KeepAlive(), rules = std::move(rules)]() mutable
+                 { compression = std::move(rules); }));
+    }
+
+    // 设置一次 gather write 合并的最大 bytes，只影响之后的发送
+    void SetWriteBatchBytes(size_t bytes)
+    {
+      asio::post(ctx, bind_handler_memory(postHandlerMemory, [this, self = KeepAlive(), bytes]()
+                 { writeBatchBytes = bytes; }));
+    }
+
     void ConnectToClient(server_interface<T> *server, uint32_t serverClientID)
     {
       if (ownerType == owner::server)
@@ -226,11 +743,17 @@ namespace net
         if (socket.is_open())
         {
           id = serverClientID;
-          // 向客户端发送验证码
-          WriteValidation();
+          this->server = server;
+
+          // 这里在 acceptor 的线程中调用，而 socket 属于 ctx，OnClientConnect 中的 Send、SetBackpressure 等已经 post 到了 ctx，
+          // 握手的读写也要 post 到 ctx 上，排在它们后面执行，不能在这里直接发起
+          asio::post(ctx, bind_handler_memory(postHandlerMemory, [this, self = KeepAlive()]()
+                                              {
+            // 向客户端发送验证码
+            WriteValidation();
 
-          // 等待客户端返回响应码，内部校验通过，开始读取 Header
-          ReadValidation(server);
+            // 等待客户端返回响应码，内部校验通过，开始读取报文
+            ReadValidation(); }));
         }
       }
     }
@@ -239,33 +762,129 @@ namespace net
     {
       if (ownerType == owner::client)
       {
-        asio::async_connect(socket, endpoints, [this](std::error_code ec, asio::ip::tcp::endpoint endpoint)
+        asio::async_connect(socket, endpoints, bind_handler_memory(readHandlerMemory, [this, self = KeepAlive()](std::error_code ec, asio::ip::tcp::endpoint endpoint)
                             {
           if(!ec){
-            // 接收服务端的验证码，计算响应码，并返回给服务端，就可以读取 Header 了
+            // 接收服务端的验证码，计算响应码，并返回给服务端，就可以读取报文了
             ReadValidation();
-          } });
+          } else {
+            NET_LOG_WARN("Connect Server Failed");
+            // 通知等待的协程连接失败
+            Close();
+          } }));
       }
     };
 
     void Send(const message<T> &msg)
     {
-      asio::post(ctx, [this, msg]()
+      Send(message<T>(msg));
+    };
+
+    // 消息一路移动到发送队列，不拷贝 body
+    void Send(message<T> &&msg)
+    {
+      metrics.outQueueDepth.fetch_add(1, std::memory_order_relaxed);
+      asio::post(ctx, bind_handler_memory(postHandlerMemory, [this, self = KeepAlive(), msg = std::move(msg), enqueued = std::chrono::steady_clock::now()]() mutable
+                 {
+                  outgoing_message<T> outgoing(std::move(msg));
+                  outgoing.enqueued = enqueued;
+                  EnqueueOutgoing(std::move(outgoing)); }));
+    };
+
+    // 回复请求，把 request 的 correlation 拷贝到 response 中，co_client::Request 据此匹配响应
+    void Reply(const message<T> &request, message<T> &&response)
+    {
+      response.header.correlation = request.header.correlation;
+      Send(std::move(response));
+    }
+
+    void Reply(const message<T> &request, const message<T> &response)
+    {
+      Reply(request, message<T>(response));
+    }
+
+    /**
+     * 发送共享的只读消息，只增加引用计数，不拷贝 body，用于广播
+     * 同一条广播的所有连接传入同一个 sharedCompression 时，需要压缩的消息只压缩一次
+     */
+    void Send(shared_message<T> msg, std::shared_ptr<shared_compression<T>> sharedCompression = nullptr)
+    {
+      metrics.outQueueDepth.fetch_add(1, std::memory_order_relaxed);
+      asio::post(ctx, bind_handler_memory(postHandlerMemory, [this, self = KeepAlive(), msg = std::move(msg), sharedCompression = std::move(sharedCompression), enqueued = std::chrono::steady_clock::now()]() mutable
                  {
-                  bool isIdle = message_out_dq.empty();
-                  // 往 out mesaage queue 添加要发送的消息 
-                  message_out_dq.emplace_back(std::move(msg));
-                  // 如果在添加消息之前，队列为空，说明此时是空闲的，因此需要唤起任务
-                  // 否则，发送消息的任务已经启动了，不需要再次启动
-                  if (isIdle)
-                    WriteHeader(); });
+                  outgoing_message<T> outgoing(std::move(msg));
+                  outgoing.sharedCompression = std::move(sharedCompression);
+                  outgoing.enqueued = enqueued;
+                  EnqueueOutgoing(std::move(outgoing)); }));
     };
 
+    /**
+     * 通过不可靠通道（UDP）发送，可能丢失、重复或者乱序，适合高频的状态更新
+     * 必须在验证通过之后才能发送，服务端的连接要等收到客户端的第一个数据报之后才能发送（之前的直接丢弃）
+     */
+    void SendUnreliable(message<T> msg)
+    {
+      if (udp == nullptr)
+        return;
+
+      asio::post(udp->Context(), bind_handler_memory(postHandlerMemory, [this, self = KeepAlive(), msg = std::move(msg)]()
+                 {
+        if (udpEndpointKnown && udp->SendTo(udpEndpoint, id, UnreliableToken(), msg))
+          metrics.datagramsOut.fetch_add(1, std::memory_order_relaxed); }));
+    }
+
+    /**
+     * 设置不可靠通道，必须在开始连接之前调用
+     * remote 为对端的 UDP 地址，服务端的连接传入 nullptr，收到第一个合法的数据报后再记录
+     */
+    void SetUnreliableChannel(udp_channel<T> *channel, const asio::ip::udp::endpoint *remote = nullptr)
+    {
+      udp = channel;
+      if (remote != nullptr)
+      {
+        udpEndpoint = *remote;
+        udpEndpointKnown = true;
+      }
+    }
+
+    // 数据报中的 token：握手时的验证结果，服务端是期望的响应码，客户端是算出的响应码
+    uint64_t UnreliableToken() const
+    {
+      return ownerType == owner::server ? exceptResponseValidation : validation;
+    }
+
+    /**
+     * udp 通道收到属于该连接的数据报，在 udp 通道的线程中调用，token 不对时丢弃并返回 false
+     * 服务端的连接会把数据报的来源记录为之后 SendUnreliable 的目标地址（客户端的地址可能因为 NAT 而变化）
+     */
+    bool ReceiveUnreliable(uint64_t token, const asio::ip::udp::endpoint &from, message<T> &&msg)
+    {
+      if (token == 0 || token != UnreliableToken())
+        return false;
+
+      if (ownerType == owner::server)
+      {
+        udpEndpoint = from;
+        udpEndpointKnown = true;
+      }
+      else if (from != udpEndpoint)
+        return false;
+
+      auto message_owner = ownerType == owner::client ? nullptr : this->shared_from_this();
+      message_in_dq.emplace_back({message_owner, std::move(msg), std::chrono::steady_clock::now()});
+      metrics.datagramsIn.fetch_add(1, std::memory_order_relaxed);
+
+      // 客户端的 udp 通道和连接在同一个线程中，可以直接通知
+      if (ownerType == owner::client && onNotify)
+        onNotify();
+      return true;
+    }
+
     void DisConnect()
     {
       if (IsConnected())
-        asio::post(ctx, [this]()
-                   { socket.close(); });
+        asio::post(ctx, bind_handler_memory(postHandlerMemory, [this, self = KeepAlive()]()
+                   { Close(); }));
     };
 
     bool IsConnected() const
@@ -0,0 +1,88 @@
+#pragma once
+
+#include "asio.hpp"
+#include <vector>
+#include <thread>
+#include <memory>
+#include <stddef.h>
+
+namespace net
+{
+  /**
+   * io_context 池，每个 io_context 独占一个线程
+   * - 一个 connection 只会绑定到其中一个 io_context 上，因此同一个连接的所有异步回调都在同一个线程中串行执行，不需要 strand
+   * - 新连接通过 GetNextContext() 轮询分配到不同的 io_context 上，从而把读写负载分摊到多个核
+   */
+  class io_context_pool
+  {
+  public:
+    explicit io_context_pool(size_t nThreads = 1)
+    {
+      if (nThreads == 0)
+        nThreads = 1;
+
+      for (size_t i = 0; i < nThreads; i++)
+      {
+        contexts.emplace_back(std::make_unique<asio::io_context>(1));
+      }
+    }
+    io_context_pool(const io_context_pool &) = delete;
+    ~io_context_pool()
+    {
+      Stop();
+    }
+
+    size_t size() const
+    {
+      return contexts.size();
+    }
+
+    asio::io_context &operator[](size_t index)
+    {
+      return *contexts[index];
+    }
+
+    // 轮询选择下一个 io_context，只在 accept 所在线程调用
+    asio::io_context &GetNextContext()
+    {
+      asio::io_context &ctx = *contexts[nextContext];
+      nextContext = (nextContext + 1) % contexts.size();
+      return ctx;
+    }
+
+    void Run()
+    {
+      if (!threads.empty())
+        return;
+
+      for (auto &ctx : contexts)
+      {
+        // 没有连接的 io_context 也不能退出 run()，否则后面分配过来的连接就没人处理了
+        works.emplace_back(asio::make_work_guard(*ctx));
+        asio::io_context *pCtx = ctx.get();
+        threads.emplace_back([pCtx]()
+                             { pCtx->run(); });
+      }
+    }
+
+    void Stop()
+    {
+      works.clear();
+      for (auto &ctx : contexts)
+        ctx->stop();
+
+      for (auto &t : threads)
+      {
+        if (t.joinable())
+          t.join();
+      }
+      threads.clear();
+    }
+
+  private:
+    std::vector<std::unique_ptr<asio::io_context>> contexts;
+    std::vector<asio::executor_work_guard<asio::io_context::executor_type>> works;
+    std::vector<std::thread> threads;
+    size_t nextContext = 0;
+  };
+}
@@ -0,0 +1,197 @@
+#pragma once
+
+#include "asio.hpp"
+#include "net_client.hpp"
+#include <deque>
+#include <optional>
+#include <unordered_map>
+#include <system_error>
+
+// 需要 C++20 协程，并且 asio 开启了 co_await 支持
+#if defined(ASIO_HAS_CO_AWAIT)
+
+namespace net
+{
+  /**
+   * 协程版本的客户端
+   * - 所有协程都通过 Spawn() 在客户端的 io_context 线程中运行，和 connection 的读写在同一个线程，不需要加锁
+   * - 收到新消息时 connection 会通过 SetNotify 唤醒等待的协程，不需要轮询 InComing()
+   * - Request() 通过 message_header::correlation 匹配响应，服务端用 Reply() 回复（会拷贝请求的 correlation）
+   * - 连接失败或断开时，所有等待中的 Receive()/Request() 都会恢复并抛出 std::system_error（not_connected）
+   * - 协程帧的内存由 asio 在线程内回收复用，稳定运行后不会每次都向系统申请
+   *
+   * example:
+   * >>> client.Connect("127.0.0.1", 5050);
+   * >>> client.Spawn([&]() -> asio::awaitable<void> {
+   * >>>   auto response = co_await client.Request(std::move(msg));
+   * >>>   auto owned = co_await client.Receive();
+   * >>> });
+   */
+  template <typename T>
+  class co_client : public client_interface<T>
+  {
+  public:
+    co_client() : signal(this->ctx)
+    {
+      // 定时器永远不会到期，只用 cancel() 唤醒所有等待的协程
+      signal.expires_at(asio::steady_timer::time_point::max());
+    }
+    virtual ~co_client()
+    {
+      // 必须在 signal 等成员析构之前停止 io_context 线程
+      this->DisConnect();
+    }
+
+    bool Connect(const std::string &host, const uint16_t &port)
+    {
+      if (!client_interface<T>::Connect(host, port))
+        return false;
+
+      // 在 io_context 线程中设置通知，之前收到的消息还在 InComing() 中，协程开始时会先取出来
+      // 设置之前连接可能已经失败了，唤醒一次已经在等待的协程，让它们重新检查连接状态
+      asio::post(this->ctx, [this]()
+                 {
+        if (this->m_connection)
+          this->m_connection->SetNotify([this]()
+                                        { signal.cancel(); });
+        signal.cancel(); });
+      return true;
+    }
+
+    // 在客户端的 io_context 线程中启动一个协程
+    template <typename F>
+    void Spawn(F &&f)
+    {
+      asio::co_spawn(this->ctx, std::forward<F>(f), asio::detached);
+    }
+
+    // 等待下一条不是响应的消息，连接断开时抛出 std::system_error
+    asio::awaitable<owned_message<T>> Receive()
+    {
+      while (true)
+      {
+        Pump();
+        if (!inbox.empty())
+        {
+          owned_message<T> msg = std::move(inbox.front());
+          inbox.pop_front();
+          co_return msg;
+        }
+
+        ThrowIfDisConnected();
+        co_await WaitSignal();
+      }
+    }
+
+    // 把消息放入发送队列，返回时消息已经在 connection 的发送队列中
+    asio::awaitable<void> Send(message<T> msg)
+    {
+      ThrowIfDisConnected();
+      client_interface<T>::Send(std::move(msg));
+      co_return;
+    }
+
+    // 发送请求并等待 correlation 相同的响应，连接断开时抛出 std::system_error
+    asio::awaitable<message<T>> Request(message<T> msg)
+    {
+      std::optional<message<T>> response = co_await Request(std::move(msg), asio::steady_timer::duration::max());
+      co_return std::move(*response);
+    }
+
+    /**
+     * 发送请求并最多等待 timeout，超时返回空，连接断开时抛出 std::system_error
+     * 超时之后才到达的响应会被丢弃，不会进入 Receive()
+     */
+    asio::awaitable<std::optional<message<T>>> Request(message<T> msg, asio::steady_timer::duration timeout)
+    {
+      ThrowIfDisConnected();
+
+      uint32_t correlation = nextCorrelation++;
+      if (nextCorrelation == 0)
+        nextCorrelation = 1;
+
+      msg.header.correlation = correlation;
+      pending[correlation];
+      client_interface<T>::Send(std::move(msg));
+
+      // 到期时唤醒所有等待的协程，各自重新检查；协程返回时 deadline 析构，回调以 operation_aborted 完成
+      asio::steady_timer deadline(this->ctx);
+      bool hasDeadline = timeout != asio::steady_timer::duration::max();
+      if (hasDeadline)
+      {
+        deadline.expires_after(timeout);
+        deadline.async_wait([this](asio::error_code ec)
+                            {
+          if (!ec)
+            signal.cancel(); });
+      }
+
+      while (true)
+      {
+        Pump();
+        auto it = pending.find(correlation);
+        if (it->second.has_value())
+        {
+          std::optional<message<T>> response = std::move(it->second);
+          pending.erase(it);
+          co_return response;
+        }
+
+        if (!this->IsConnected())
+        {
+          pending.erase(it);
+          ThrowIfDisConnected();
+        }
+
+        if (hasDeadline && asio::steady_timer::clock_type::now() >= deadline.expiry())
+        {
+          pending.erase(it);
+          co_return std::nullopt;
+        }
+        co_await WaitSignal();
+      }
+    }
+
+  protected:
+    asio::steady_timer signal;
+    // 收到的普通消息，等待 Receive() 取走
+    std::deque<owned_message<T>> inbox;
+    // 正在等待响应的请求
+    std::unordered_map<uint32_t, std::optional<message<T>>> pending;
+    uint32_t nextCorrelation = 1;
+
+    // 把 InComing() 中的消息分发给等待的请求或者 inbox
+    void Pump()
+    {
+      auto &incoming = this->InComing();
+      while (!incoming.empty())
+      {
+        owned_message<T> msg = incoming.pop_front();
+        if (msg.msg.header.correlation != 0)
+        {
+          // 找不到请求说明已经超时或者放弃，丢弃迟到的响应
+          auto it = pending.find(msg.msg.header.correlation);
+          if (it != pending.end())
+            it->second = std::move(msg.msg);
+          continue;
+        }
+        inbox.emplace_back(std::move(msg));
+      }
+    }
+
+    asio::awaitable<void> WaitSignal()
+    {
+      // 被 cancel() 唤醒时会返回 operation_aborted，这是正常的
+      asio::error_code ec;
+      co_await signal.async_wait(asio::redirect_error(asio::use_awaitable, ec));
+    }
+
+    void ThrowIfDisConnected()
+    {
+      if (!this->IsConnected())
+        throw std::system_error(std::make_error_code(std::errc::not_connected));
+    }
+  };
+}
+
+#endif
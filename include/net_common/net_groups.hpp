@@ -0,0 +1,101 @@
+#pragma once
+
+#include "net_registry.hpp"
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <unordered_map>
+#include <stddef.h>
+#include <stdint.h>
+
+namespace net
+{
+  /**
+   * 广播组（房间、频道、空间区域），一个连接可以同时属于多个组
+   * - 每个组的成员是一个 connection_registry，紧凑地保存在数组中，向组广播只遍历组内成员
+   * - memberOf 记录每个连接加入了哪些组，连接断开时据此把它从所有组中移除
+   * - 没有成员的组会被删除
+   * - 本身不是线程安全的，由 server_interface 加锁访问
+   */
+  template <typename T>
+  class group_registry
+  {
+  protected:
+    std::unordered_map<uint32_t, connection_registry<T>> groups;
+    std::unordered_map<uint32_t, std::vector<uint32_t>> memberOf;
+
+  public:
+    // 已经在组中返回 false
+    bool subscribe(uint32_t group, std::shared_ptr<connection<T>> client)
+    {
+      uint32_t id = client->GetID();
+      if (!groups[group].add(id, std::move(client)))
+        return false;
+
+      memberOf[id].emplace_back(group);
+      return true;
+    }
+
+    // 不在组中返回 false
+    bool unsubscribe(uint32_t group, uint32_t id)
+    {
+      auto it = groups.find(group);
+      if (it == groups.end() || it->second.remove(id) == nullptr)
+        return false;
+
+      if (it->second.size() == 0)
+        groups.erase(it);
+
+      auto member = memberOf.find(id);
+      std::vector<uint32_t> &joined = member->second;
+      joined.erase(std::find(joined.begin(), joined.end(), group));
+      if (joined.empty())
+        memberOf.erase(member);
+      return true;
+    }
+
+    // 从所有组中移除，返回移除前加入的组个数
+    size_t unsubscribe_all(uint32_t id)
+    {
+      auto member = memberOf.find(id);
+      if (member == memberOf.end())
+        return 0;
+
+      std::vector<uint32_t> joined = std::move(member->second);
+      memberOf.erase(member);
+      for (uint32_t group : joined)
+      {
+        auto it = groups.find(group);
+        it->second.remove(id);
+        if (it->second.size() == 0)
+          groups.erase(it);
+      }
+      return joined.size();
+    }
+
+    // 组不存在（没有成员）返回 nullptr
+    connection_registry<T> *find(uint32_t group)
+    {
+      auto it = groups.find(group);
+      return it == groups.end() ? nullptr : &it->second;
+    }
+
+    // 连接加入的所有组
+    std::vector<uint32_t> groups_of(uint32_t id) const
+    {
+      auto member = memberOf.find(id);
+      return member == memberOf.end() ? std::vector<uint32_t>() : member->second;
+    }
+
+    size_t size() const
+    {
+      return groups.size();
+    }
+
+    void clear()
+    {
+      groups.clear();
+      memberOf.clear();
+    }
+  };
+}
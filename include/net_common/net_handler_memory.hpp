@@ -0,0 +1,152 @@
+#pragma once
+
+#include "asio.hpp"
+#include <atomic>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <stddef.h>
+#include <stdint.h>
+
+namespace net
+{
+  // 所有 handler_memory 退回 ::operator new 的次数，稳定运行后应该不再增长
+  inline std::atomic<uint64_t> &handler_memory_fallbacks()
+  {
+    static std::atomic<uint64_t> count{0};
+    return count;
+  }
+
+  /**
+   * 异步操作回调（handler）的内存，每个连接持有几块，反复复用
+   * - asio 每次 async_read/async_write/post 都要为操作对象申请一块内存，大小取决于 handler 捕获的内容
+   * - 有 Slots 块，每块 SlotBytes，空闲的块用原子标记抢占，因此可以在一个线程中分配、在另一个线程中释放（例如业务线程 post，I/O 线程执行）
+   * - 请求超过 SlotBytes 或者所有块都在使用时，退回 ::operator new
+   * - asio 在调用 handler 之前就会释放操作对象的内存，所以读、写这种一个接一个发起的异步操作只需要一块
+   */
+  template <size_t SlotBytes, size_t Slots = 1>
+  class handler_memory
+  {
+  protected:
+    struct alignas(std::max_align_t) slot
+    {
+      unsigned char bytes[SlotBytes];
+    };
+
+    slot storage[Slots];
+    std::atomic<bool> inUse[Slots] = {};
+
+  public:
+    handler_memory() = default;
+    handler_memory(const handler_memory &) = delete;
+    handler_memory &operator=(const handler_memory &) = delete;
+
+    void *Allocate(size_t bytes)
+    {
+      if (bytes <= SlotBytes)
+      {
+        for (size_t i = 0; i < Slots; i++)
+        {
+          // 先读一次，已经被占用的块不去抢，减少 cache line 争用
+          if (!inUse[i].load(std::memory_order_relaxed) && !inUse[i].exchange(true, std::memory_order_acquire))
+            return &storage[i];
+        }
+      }
+      handler_memory_fallbacks().fetch_add(1, std::memory_order_relaxed);
+      return ::operator new(bytes);
+    }
+
+    void Deallocate(void *p)
+    {
+      for (size_t i = 0; i < Slots; i++)
+      {
+        if (p == &storage[i])
+        {
+          inUse[i].store(false, std::memory_order_release);
+          return;
+        }
+      }
+      ::operator delete(p);
+    }
+  };
+
+  /**
+   * 从 handler_memory 分配的 allocator，作为 handler 的 associated allocator 交给 asio
+   */
+  template <typename U, typename Memory>
+  class handler_allocator
+  {
+  public:
+    using value_type = U;
+
+    explicit handler_allocator(Memory &memory) : memory(&memory) {}
+    template <typename V>
+    handler_allocator(const handler_allocator<V, Memory> &other) : memory(other.memory) {}
+
+    U *allocate(size_t n)
+    {
+      return static_cast<U *>(memory->Allocate(sizeof(U) * n));
+    }
+
+    void deallocate(U *p, size_t)
+    {
+      memory->Deallocate(p);
+    }
+
+    template <typename V>
+    bool operator==(const handler_allocator<V, Memory> &other) const { return memory == other.memory; }
+    template <typename V>
+    bool operator!=(const handler_allocator<V, Memory> &other) const { return memory != other.memory; }
+
+  private:
+    template <typename, typename>
+    friend class handler_allocator;
+
+    Memory *memory;
+  };
+
+  /**
+   * 带 associated allocator 的 handler，asio 通过 get_allocator() 为操作对象分配内存
+   */
+  template <typename Handler, typename Memory>
+  class memory_bound_handler
+  {
+  public:
+    using allocator_type = handler_allocator<Handler, Memory>;
+
+    memory_bound_handler(Memory &memory, Handler handler) : memory(memory), handler(std::move(handler)) {}
+
+    allocator_type get_allocator() const noexcept
+    {
+      return allocator_type(memory);
+    }
+
+    template <typename... Args>
+    void operator()(Args &&...args)
+    {
+      handler(std::forward<Args>(args)...);
+    }
+
+  protected:
+    Memory &memory;
+    Handler handler;
+  };
+
+  /**
+   * 让 handler 的操作对象从 memory 中分配
+   * 定义 NET_DISABLE_HANDLER_MEMORY 后直接返回 handler，使用 asio 默认的分配方式
+   */
+#ifdef NET_DISABLE_HANDLER_MEMORY
+  template <typename Memory, typename Handler>
+  inline typename std::decay<Handler>::type bind_handler_memory(Memory &, Handler &&handler)
+  {
+    return std::forward<Handler>(handler);
+  }
+#else
+  template <typename Memory, typename Handler>
+  inline memory_bound_handler<typename std::decay<Handler>::type, Memory> bind_handler_memory(Memory &memory, Handler &&handler)
+  {
+    return memory_bound_handler<typename std::decay<Handler>::type, Memory>(memory, std::forward<Handler>(handler));
+  }
+#endif
+}
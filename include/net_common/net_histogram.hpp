@@ -0,0 +1,132 @@
+#pragma once
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+
+namespace net
+{
+  /**
+   * 对数-线性分桶的直方图（HDR histogram 的简化版），用来统计延迟等数值的分布
+   * - 小于 16 的值每个值一个桶，之后每个 2 的幂区间再均分为 16 个桶，相对误差不超过 1/16
+   * - 桶计数都是原子变量，可以多个线程同时 Record，另一个线程读取
+   */
+  class latency_histogram
+  {
+  public:
+    static constexpr size_t SubBuckets = 16;
+    static constexpr size_t NumBuckets = (64 - 3) * SubBuckets;
+
+    latency_histogram()
+    {
+      Reset();
+    }
+    latency_histogram(const latency_histogram &) = delete;
+
+    void Record(uint64_t value)
+    {
+      counts[BucketIndex(value)].fetch_add(1, std::memory_order_relaxed);
+      total.fetch_add(1, std::memory_order_relaxed);
+
+      uint64_t oldMax = maxValue.load(std::memory_order_relaxed);
+      while (value > oldMax && !maxValue.compare_exchange_weak(oldMax, value, std::memory_order_relaxed))
+      {
+      }
+    }
+
+    uint64_t Count() const
+    {
+      return total.load(std::memory_order_relaxed);
+    }
+
+    uint64_t Max() const
+    {
+      return maxValue.load(std::memory_order_relaxed);
+    }
+
+    // 返回第 p 百分位（0 ~ 100）所在桶的上界，没有数据返回 0
+    uint64_t Percentile(double p) const
+    {
+      uint64_t n = Count();
+      if (n == 0)
+        return 0;
+
+      uint64_t target = uint64_t(p / 100.0 * double(n) + 0.5);
+      if (target == 0)
+        target = 1;
+
+      uint64_t seen = 0;
+      for (size_t i = 0; i < NumBuckets; i++)
+      {
+        seen += counts[i].load(std::memory_order_relaxed);
+        if (seen >= target)
+        {
+          uint64_t upper = BucketUpper(i);
+          return upper < Max() ? upper : Max();
+        }
+      }
+      return Max();
+    }
+
+    // 把另一个直方图的数据合并进来
+    void Merge(const latency_histogram &other)
+    {
+      for (size_t i = 0; i < NumBuckets; i++)
+        counts[i].fetch_add(other.counts[i].load(std::memory_order_relaxed), std::memory_order_relaxed);
+      total.fetch_add(other.Count(), std::memory_order_relaxed);
+
+      uint64_t otherMax = other.Max();
+      uint64_t oldMax = maxValue.load(std::memory_order_relaxed);
+      while (otherMax > oldMax && !maxValue.compare_exchange_weak(oldMax, otherMax, std::memory_order_relaxed))
+      {
+      }
+    }
+
+    void Reset()
+    {
+      for (size_t i = 0; i < NumBuckets; i++)
+        counts[i].store(0, std::memory_order_relaxed);
+      total.store(0, std::memory_order_relaxed);
+      maxValue.store(0, std::memory_order_relaxed);
+    }
+
+  private:
+    std::atomic<uint64_t> counts[NumBuckets];
+    std::atomic<uint64_t> total;
+    std::atomic<uint64_t> maxValue;
+
+    static size_t HighestBit(uint64_t value)
+    {
+      size_t bit = 0;
+      for (size_t shift = 32; shift > 0; shift >>= 1)
+      {
+        if (value >> (bit + shift))
+          bit += shift;
+      }
+      return bit;
+    }
+
+    static size_t BucketIndex(uint64_t value)
+    {
+      if (value < SubBuckets)
+        return size_t(value);
+
+      // value 在 [2^e, 2^(e+1)) 中，取最高 5 位中的低 4 位作为桶内下标
+      size_t e = HighestBit(value);
+      size_t sub = size_t(value >> (e - 4)) - SubBuckets;
+      return (e - 3) * SubBuckets + sub;
+    }
+
+    static uint64_t BucketUpper(size_t index)
+    {
+      size_t group = index / SubBuckets;
+      size_t sub = index % SubBuckets;
+      if (group == 0)
+        return sub;
+
+      size_t e = group + 3;
+      uint64_t lower = uint64_t(SubBuckets + sub) << (e - 4);
+      return lower + (uint64_t(1) << (e - 4)) - 1;
+    }
+  };
+}
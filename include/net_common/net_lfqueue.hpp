@@ -0,0 +1,269 @@
+#pragma once
+
+#include "net_tsqueue.hpp"
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <utility>
+#include <type_traits>
+#include <stddef.h>
+
+namespace net
+{
+  /**
+   * 阻塞消费者用的等待器，只有消费者真的在睡眠时，生产者才会去加锁 notify
+   * 生产者先发布数据再读 sleeping，消费者先写 sleeping 再检查数据，中间都有 seq_cst fence，两边至少有一边能看到对方
+   */
+  class lf_waiter
+  {
+  protected:
+    std::mutex _mutex;
+    std::condition_variable cond;
+    std::atomic<bool> sleeping{false};
+
+  public:
+    template <typename Pred>
+    void wait(Pred isReady)
+    {
+      if (isReady())
+        return;
+
+      std::unique_lock<std::mutex> lock(_mutex);
+      sleeping.store(true);
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      while (!isReady())
+      {
+        cond.wait(lock);
+      }
+      sleeping.store(false);
+    }
+
+    // 最多等待 timeout，返回 isReady()
+    template <typename Pred, typename Rep, typename Period>
+    bool wait_for(Pred isReady, const std::chrono::duration<Rep, Period> &timeout)
+    {
+      if (isReady())
+        return true;
+
+      std::unique_lock<std::mutex> lock(_mutex);
+      sleeping.store(true);
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      bool ready = cond.wait_for(lock, timeout, isReady);
+      sleeping.store(false);
+      return ready;
+    }
+
+    void notify()
+    {
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      if (sleeping.load(std::memory_order_relaxed))
+      {
+        std::lock_guard<std::mutex> lock(_mutex);
+        cond.notify_one();
+      }
+    }
+  };
+
+  /**
+   * 有界无锁 MPSC 环形队列（多生产者，单消费者）
+   * - 用于服务端共享的接收队列：所有连接的 I/O 线程写入，Update() 所在线程读取
+   * - 每个槽位有一个序号，生产者通过 CAS 抢占写入位置，写完后发布序号，消费者看到序号才读取
+   * - 队列满时生产者在 emplace_back 中循环 yield，直到消费者取走数据；作为接收队列时生产者是 I/O 线程，
+   *   这段时间该线程上所有连接的读写都会停下来（相当于对读取 socket 做了限流，同时也会推迟发送），
+   *   所以容量要能容纳 Update() 两次调用之间到达的消息，Update() 也不能长时间不调用；不想阻塞时用 try_emplace_back
+   * - 接口和 tsqueue 保持一致，pop_front/front 只能由唯一的消费者调用
+   */
+  template <typename T>
+  class mpsc_queue
+  {
+  protected:
+    struct cell
+    {
+      std::atomic<size_t> sequence;
+      typename std::aligned_storage<sizeof(T), alignof(T)>::type storage;
+    };
+
+    std::unique_ptr<cell[]> cells;
+    size_t mask;
+
+    // 生产者和消费者的位置放到不同的 cache line，避免伪共享
+    alignas(64) std::atomic<size_t> enqueuePos{0};
+    alignas(64) std::atomic<size_t> dequeuePos{0};
+
+    lf_waiter waiter;
+
+    T *item_ptr(cell &c)
+    {
+      return reinterpret_cast<T *>(&c.storage);
+    }
+
+    // 消费者的下一个槽位是否已经被发布
+    bool ready()
+    {
+      size_t pos = dequeuePos.load(std::memory_order_relaxed);
+      return cells[pos & mask].sequence.load(std::memory_order_acquire) == pos + 1;
+    }
+
+    template <typename U>
+    bool try_push(U &&item)
+    {
+      cell *c;
+      size_t pos = enqueuePos.load(std::memory_order_relaxed);
+      while (true)
+      {
+        c = &cells[pos & mask];
+        size_t seq = c->sequence.load(std::memory_order_acquire);
+        intptr_t diff = intptr_t(seq) - intptr_t(pos);
+        if (diff == 0)
+        {
+          if (enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+            break;
+        }
+        else if (diff < 0)
+        {
+          // 队列满
+          return false;
+        }
+        else
+        {
+          pos = enqueuePos.load(std::memory_order_relaxed);
+        }
+      }
+
+      new (&c->storage) T(std::forward<U>(item));
+      c->sequence.store(pos + 1, std::memory_order_release);
+      waiter.notify();
+      return true;
+    }
+
+    template <typename U>
+    void push(U &&item)
+    {
+      while (!try_push(std::forward<U>(item)))
+        std::this_thread::yield();
+    }
+
+  public:
+    // capacity 会向上取整为 2 的幂
+    explicit mpsc_queue(size_t capacity = 16 * 1024)
+    {
+      size_t size = 2;
+      while (size < capacity)
+        size <<= 1;
+
+      mask = size - 1;
+      cells.reset(new cell[size]);
+      for (size_t i = 0; i < size; i++)
+        cells[i].sequence.store(i, std::memory_order_relaxed);
+    }
+    mpsc_queue(const mpsc_queue &) = delete;
+    ~mpsc_queue()
+    {
+      clear();
+    }
+
+    size_t capacity() const
+    {
+      return mask + 1;
+    }
+
+    bool try_emplace_back(const T &item)
+    {
+      return try_push(item);
+    }
+
+    bool try_emplace_back(T &&item)
+    {
+      return try_push(std::move(item));
+    }
+
+    void emplace_back(const T &item)
+    {
+      push(item);
+    }
+
+    void emplace_back(T &&item)
+    {
+      push(std::move(item));
+    }
+
+    const T &front()
+    {
+      while (!ready())
+        std::this_thread::yield();
+      return *item_ptr(cells[dequeuePos.load(std::memory_order_relaxed) & mask]);
+    }
+
+    bool empty()
+    {
+      return !ready();
+    }
+
+    void wait()
+    {
+      waiter.wait([this]()
+                  { return ready(); });
+    }
+
+    template <typename Rep, typename Period>
+    bool wait_for(const std::chrono::duration<Rep, Period> &timeout)
+    {
+      return waiter.wait_for([this]()
+                             { return ready(); },
+                             timeout);
+    }
+
+    // 只是一个近似值，生产者可能已经占了位置但还没有写完
+    size_t count()
+    {
+      return enqueuePos.load(std::memory_order_acquire) - dequeuePos.load(std::memory_order_acquire);
+    }
+
+    void clear()
+    {
+      while (ready())
+        pop_front();
+    }
+
+    // 取出最多 maxCount 个已经发布的元素，追加到 out 的尾部，返回取出的个数
+    size_t pop_front_batch(pooled_deque<T> &out, size_t maxCount)
+    {
+      size_t n = 0;
+      while (n < maxCount && ready())
+      {
+        out.emplace_back(pop_front());
+        n++;
+      }
+      return n;
+    }
+
+    T pop_front()
+    {
+      size_t pos = dequeuePos.load(std::memory_order_relaxed);
+      cell &c = cells[pos & mask];
+      // 生产者可能已经占了这个位置但还没有写完
+      while (c.sequence.load(std::memory_order_acquire) != pos + 1)
+        std::this_thread::yield();
+
+      T *p = item_ptr(c);
+      T t = std::move(*p);
+      p->~T();
+      c.sequence.store(pos + mask + 1, std::memory_order_release);
+      dequeuePos.store(pos + 1, std::memory_order_release);
+      return t;
+    }
+  };
+
+  /**
+   * 接收队列的类型，定义 NET_USE_LOCKFREE_QUEUE 后使用无锁的 mpsc_queue，否则使用 tsqueue
+   * 发送队列 message_out_dq 的读写都发生在连接自己的 io_context 线程中（Send 会先 post 过去），没有跨线程竞争，不需要这里的队列
+   */
+#ifdef NET_USE_LOCKFREE_QUEUE
+  template <typename T>
+  using inbound_queue = mpsc_queue<T>;
+#else
+  template <typename T>
+  using inbound_queue = tsqueue<T>;
+#endif
+}
@@ -0,0 +1,294 @@
+#pragma once
+
+#include "net_lfqueue.hpp"
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <streambuf>
+#include <thread>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * 编译期日志级别：0 trace, 1 debug, 2 info, 3 warn, 4 error, 5 off
+ * 低于该级别的 NET_LOG_XXX 展开为空语句，参数也不会求值；定义为 5 时完全没有日志的开销
+ */
+#ifndef NET_LOG_LEVEL
+#define NET_LOG_LEVEL 2
+#endif
+
+namespace net
+{
+  enum class log_level : int
+  {
+    trace,
+    debug,
+    info,
+    warn,
+    error,
+    off,
+  };
+
+  /**
+   * 一条日志，固定大小，放在环形队列中不需要申请内存，超长的内容会被截断
+   */
+  struct log_record
+  {
+    static constexpr size_t MaxText = 240;
+
+    log_level level = log_level::info;
+    std::chrono::system_clock::time_point time;
+    uint32_t length = 0;
+    char text[MaxText];
+  };
+
+  /**
+   * 日志的输出目标，只在后台线程中调用，实现不需要考虑线程安全
+   */
+  class log_sink
+  {
+  public:
+    virtual ~log_sink() {}
+    virtual void Write(const log_record &record) = 0;
+    // 每写完一批日志调用一次
+    virtual void Flush() {}
+  };
+
+  // 默认的输出：warn 和 error 输出到 std::cerr，其余输出到 std::cout，格式和原来直接输出时一样
+  class console_log_sink : public log_sink
+  {
+  public:
+    virtual void Write(const log_record &record)
+    {
+      std::ostream &out = record.level >= log_level::warn ? std::cerr : std::cout;
+      out.write(record.text, record.length);
+      out.put('\n');
+    }
+
+    virtual void Flush()
+    {
+      std::cout.flush();
+      std::cerr.flush();
+    }
+  };
+
+  /**
+   * 格式化到固定大小的缓冲区，用于 NET_LOG_XXX 宏，每个线程复用一个
+   */
+  class log_stream : private std::streambuf, public std::ostream
+  {
+  public:
+    log_stream() : std::ostream(this)
+    {
+      Reset();
+    }
+
+    static log_stream &Local()
+    {
+      thread_local log_stream stream;
+      stream.Reset();
+      return stream;
+    }
+
+    void Reset()
+    {
+      setp(buffer, buffer + log_record::MaxText);
+      clear();
+    }
+
+    const char *data() const
+    {
+      return pbase();
+    }
+
+    size_t size() const
+    {
+      return size_t(pptr() - pbase());
+    }
+
+  private:
+    // 缓冲区写满后 overflow 返回 eof，之后的内容被丢弃
+    char buffer[log_record::MaxText];
+  };
+
+  /**
+   * 异步日志
+   * - I/O 线程只把格式化好的日志放入无锁 MPSC 环形队列，由后台线程批量写入 sink，每批只 flush 一次
+   * - 队列满时直接丢弃并计数，不会阻塞 I/O 线程
+   * - 后台线程在第一次写日志时启动，程序退出时写完剩余的日志再结束
+   */
+  class logger
+  {
+  public:
+    static logger &Instance()
+    {
+      static logger instance;
+      return instance;
+    }
+
+    logger(const logger &) = delete;
+    ~logger()
+    {
+      // 停止标记，阻塞放入，保证后台线程一定能收到
+      log_record stop;
+      stop.level = log_level::off;
+      records.emplace_back(std::move(stop));
+      worker.join();
+    }
+
+    // 替换输出目标，可以在任意线程中调用
+    void SetSink(std::shared_ptr<log_sink> newSink)
+    {
+      std::lock_guard<std::mutex> lock(sinkMutex);
+      sink = std::move(newSink);
+    }
+
+    // 运行期级别，只能比编译期的 NET_LOG_LEVEL 更高，更低的级别会被提高到 NET_LOG_LEVEL（低于它的宏已经展开为空语句）
+    void SetLevel(log_level newLevel)
+    {
+      if (newLevel < log_level(NET_LOG_LEVEL))
+        newLevel = log_level(NET_LOG_LEVEL);
+      level.store(newLevel, std::memory_order_relaxed);
+    }
+
+    bool Enabled(log_level l) const
+    {
+      return l >= level.load(std::memory_order_relaxed);
+    }
+
+    void Log(log_level l, const char *text, size_t length)
+    {
+      log_record record;
+      record.level = l;
+      record.time = std::chrono::system_clock::now();
+      record.length = uint32_t(length < log_record::MaxText ? length : log_record::MaxText);
+      std::memcpy(record.text, text, record.length);
+
+      if (records.try_emplace_back(std::move(record)))
+        enqueued.fetch_add(1, std::memory_order_release);
+      else
+        dropped.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // 等待调用之前的日志都写入 sink
+    void Flush()
+    {
+      uint64_t target = enqueued.load(std::memory_order_acquire);
+      while (written.load(std::memory_order_acquire) < target)
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    // 因为队列满而丢弃的日志条数
+    uint64_t Dropped() const
+    {
+      return dropped.load(std::memory_order_relaxed);
+    }
+
+  protected:
+    mpsc_queue<log_record> records;
+    std::atomic<log_level> level{log_level(NET_LOG_LEVEL)};
+    std::atomic<uint64_t> enqueued{0};
+    std::atomic<uint64_t> written{0};
+    std::atomic<uint64_t> dropped{0};
+    std::mutex sinkMutex;
+    std::shared_ptr<log_sink> sink;
+    std::thread worker;
+
+    logger() : records(4096), sink(std::make_shared<console_log_sink>())
+    {
+      worker = std::thread([this]()
+                           { Run(); });
+    }
+
+    void Run()
+    {
+      pooled_deque<log_record> batch;
+      bool running = true;
+      while (running)
+      {
+        records.wait();
+        records.pop_front_batch(batch, size_t(-1));
+
+        std::lock_guard<std::mutex> lock(sinkMutex);
+        uint64_t n = 0;
+        for (auto &record : batch)
+        {
+          if (record.level == log_level::off)
+          {
+            running = false;
+            continue;
+          }
+          if (sink)
+            sink->Write(record);
+          n++;
+        }
+        if (sink)
+          sink->Flush();
+
+        batch.clear();
+        written.fetch_add(n, std::memory_order_release);
+      }
+    }
+  };
+}
+
+#define NET_LOG(lvl, expr)                                                \
+  do                                                                      \
+  {                                                                       \
+    if (::net::logger::Instance().Enabled(lvl))                           \
+    {                                                                     \
+      ::net::log_stream &netLogStream = ::net::log_stream::Local();       \
+      netLogStream << expr;                                               \
+      ::net::logger::Instance().Log(lvl, netLogStream.data(), netLogStream.size()); \
+    }                                                                     \
+  } while (0)
+
+#if NET_LOG_LEVEL <= 0
+#define NET_LOG_TRACE(expr) NET_LOG(::net::log_level::trace, expr)
+#else
+#define NET_LOG_TRACE(expr) \
+  do                        \
+  {                         \
+  } while (0)
+#endif
+
+#if NET_LOG_LEVEL <= 1
+#define NET_LOG_DEBUG(expr) NET_LOG(::net::log_level::debug, expr)
+#else
+#define NET_LOG_DEBUG(expr) \
+  do                        \
+  {                         \
+  } while (0)
+#endif
+
+#if NET_LOG_LEVEL <= 2
+#define NET_LOG_INFO(expr) NET_LOG(::net::log_level::info, expr)
+#else
+#define NET_LOG_INFO(expr) \
+  do                       \
+  {                        \
+  } while (0)
+#endif
+
+#if NET_LOG_LEVEL <= 3
+#define NET_LOG_WARN(expr) NET_LOG(::net::log_level::warn, expr)
+#else
+#define NET_LOG_WARN(expr) \
+  do                       \
+  {                        \
+  } while (0)
+#endif
+
+#if NET_LOG_LEVEL <= 4
+#define NET_LOG_ERROR(expr) NET_LOG(::net::log_level::error, expr)
+#else
+#define NET_LOG_ERROR(expr) \
+  do                        \
+  {                         \
+  } while (0)
+#endif
@@ -5,6 +5,19 @@
 #include <vector>
 #include <cstring>
 #include <memory>
+#include <mutex>
+#include <chrono>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include "net_buffer_pool.hpp"
+
+#if __has_include(<version>)
+#include <version>
+#endif
+#if defined(__cpp_lib_span)
+#include <span>
+#endif
 
 namespace net
 {
@@ -20,10 +33,186 @@ namespace net
     T id;
     /**
      * 整个消息包体的 bytes，不包括消息头
+     * 网络上传输时最高位为 1 表示消息体经过压缩（见 net_compress.hpp），接收方解压后会清除该位，业务代码看到的总是原始大小
      */
     uint32_t size = 0;
+    /**
+     * 请求/响应的关联 ID，0 表示普通消息
+     * 客户端 Request 时会分配一个 ID，服务端回复时把请求的 correlation 拷贝到响应中，客户端据此匹配响应
+     */
+    uint32_t correlation = 0;
+
+    static constexpr uint32_t CompressedFlag = 0x80000000u;
   };
 
+  template <typename T>
+  class message_reader;
+
+  /**
+   * body 中定长元素数组的只读视图，不拷贝，只在 message 存活期间有效
+   * 元素在 body 中不一定对齐，因此不提供 E*，operator[] 按值返回（memcpy）
+   * example:
+   * >>> net::array_view<float> samples;
+   * >>> r >> samples;
+   * >>> float first = samples[0];
+   **/
+  template <typename E>
+  class array_view
+  {
+    static_assert(std::is_trivially_copyable<E>::value, "Element is too complex and it cannot be serialized");
+
+  protected:
+    const uint8_t *bytes = nullptr;
+    size_t count = 0;
+
+  public:
+    array_view() = default;
+    array_view(const uint8_t *bytes, size_t count) : bytes(bytes), count(count) {}
+
+    size_t size() const
+    {
+      return count;
+    }
+
+    bool empty() const
+    {
+      return count == 0;
+    }
+
+    const uint8_t *data() const
+    {
+      return bytes;
+    }
+
+    E operator[](size_t i) const
+    {
+      E e;
+      std::memcpy(&e, bytes + i * sizeof(E), sizeof(E));
+      return e;
+    }
+
+    // 一次拷贝全部元素到 out（至少 size() 个元素）
+    void copy_to(E *out) const
+    {
+      if (count > 0)
+        std::memcpy(out, bytes, count * sizeof(E));
+    }
+  };
+
+  namespace detail
+  {
+    // 变长数据的长度使用 varint（LEB128）编码，每 byte 7 位，64 位整数最多 10 bytes
+    constexpr size_t MaxVarintBytes = 10;
+
+    inline size_t varint_size(uint64_t v)
+    {
+      size_t n = 1;
+      for (; v >= 0x80; v >>= 7)
+        n++;
+      return n;
+    }
+
+    inline uint8_t *write_varint(uint8_t *p, uint64_t v)
+    {
+      for (; v >= 0x80; v >>= 7)
+        *p++ = uint8_t(v | 0x80);
+      *p++ = uint8_t(v);
+      return p;
+    }
+
+    // 变长数据在内存中连续的内容：元素个数和 bytes
+    struct varlen_bytes
+    {
+      const void *data;
+      size_t count;
+      size_t bytes;
+    };
+
+    template <typename C, typename Traits, typename Alloc>
+    inline varlen_bytes as_varlen(const std::basic_string<C, Traits, Alloc> &s)
+    {
+      return {s.data(), s.size(), s.size() * sizeof(C)};
+    }
+
+    template <typename C, typename Traits>
+    inline varlen_bytes as_varlen(const std::basic_string_view<C, Traits> &s)
+    {
+      return {s.data(), s.size(), s.size() * sizeof(C)};
+    }
+
+    template <typename E, typename Alloc>
+    inline varlen_bytes as_varlen(const std::vector<E, Alloc> &v)
+    {
+      static_assert(std::is_trivially_copyable<E>::value && !std::is_same<E, bool>::value, "Vector element is too complex and it cannot be serialized");
+      return {v.data(), v.size(), v.size() * sizeof(E)};
+    }
+
+    template <typename E>
+    inline varlen_bytes as_varlen(const array_view<E> &v)
+    {
+      return {v.data(), v.size(), v.size() * sizeof(E)};
+    }
+
+#if defined(__cpp_lib_span)
+    template <typename E, size_t Extent>
+    inline varlen_bytes as_varlen(const std::span<E, Extent> &s)
+    {
+      static_assert(std::is_trivially_copyable<std::remove_cv_t<E>>::value, "Span element is too complex and it cannot be serialized");
+      return {s.data(), s.size(), s.size_bytes()};
+    }
+#endif
+
+    /**
+     * 变长数据：std::string、std::string_view、元素可以直接拷贝的 std::vector、array_view、std::span（C++20）
+     * 编码为 varint 元素个数 + 全部元素的 bytes（一次 memcpy）
+     * 它们本身也是 standard layout，不能按定长数据直接拷贝对象的 bytes
+     */
+    template <typename D, typename = void>
+    struct is_varlen : std::false_type
+    {
+    };
+
+    template <typename D>
+    struct is_varlen<D, std::void_t<decltype(as_varlen(std::declval<const D &>()))>> : std::true_type
+    {
+    };
+
+    // 编码后的 bytes，定长数据为编译期常量
+    template <typename D>
+    inline size_t encoded_size(const D &data)
+    {
+      if constexpr (is_varlen<D>::value)
+      {
+        varlen_bytes v = as_varlen(data);
+        return varint_size(v.count) + v.bytes;
+      }
+      else
+      {
+        static_assert(std::is_standard_layout<D>::value, "Data is too complex and it cannot be serialized");
+        return sizeof(D);
+      }
+    }
+
+    // 编码到 p，返回写入之后的位置
+    template <typename D>
+    inline uint8_t *encode_to(uint8_t *p, const D &data)
+    {
+      if constexpr (is_varlen<D>::value)
+      {
+        varlen_bytes v = as_varlen(data);
+        p = write_varint(p, v.count);
+        if (v.bytes > 0)
+          std::memcpy(p, v.data, v.bytes);
+        return p + v.bytes;
+      }
+      else
+      {
+        std::memcpy(p, &data, sizeof(D));
+        return p + sizeof(D);
+      }
+    }
+  }
+
   template <typename T>
   /**
    * 服务端和客户端传递的消息包
@@ -35,22 +224,38 @@ namespace net
      */
     message_header<T> header;
     /**
-     * 消息体
+     * 消息体，内存来自 buffer_pool，释放后会被复用
      */
-    std::vector<uint8_t> body;
+    body_buffer body;
 
     message() {}
     message(const message<T> &other)
     {
       header = other.header;
-      body = other.body;
+      assign_bytes(body, other.body.data(), other.body.size());
     }
-    message(message<T> &&other)
+    message(message<T> &&other) noexcept
     {
       header = other.header;
       body = std::move(other.body);
       other.header.size = 0;
     }
+    message<T> &operator=(const message<T> &other)
+    {
+      if (this == &other)
+        return *this;
+
+      header = other.header;
+      assign_bytes(body, other.body.data(), other.body.size());
+      return *this;
+    }
+    message<T> &operator=(message<T> &&other) noexcept
+    {
+      header = other.header;
+      body = std::move(other.body);
+      other.header.size = 0;
+      return *this;
+    }
 
     // 返回整个消息包体的 bytes
     size_t size() const
@@ -58,6 +263,42 @@ namespace net
       return body.size();
     }
 
+    // 预留 body 的容量（bytes），之后多次写入不会重新分配内存
+    void reserve(size_t bytes)
+    {
+      body.reserve(bytes);
+    }
+
+    /**
+     * 一次写入多个数据到 body 尾部，先计算总大小（定长数据在编译期计算），body 只 resize 一次
+     * 字符串、vector、span 等变长数据写入 varint 元素个数 + 内容（见 detail::is_varlen）
+     * example:
+     * >>> message<T> msg;
+     * >>> msg.write(x, y, hp);
+     * >>> msg.write(userID, std::string_view("hello"));
+     **/
+    template <typename... DataTypes>
+    message<T> &write(const DataTypes &...data)
+    {
+      static_assert(sizeof...(DataTypes) > 0, "Nothing to write");
+
+      size_t total = (detail::encoded_size(data) + ...);
+      size_t ori_body_size = body.size();
+      body.resize(ori_body_size + total);
+
+      uint8_t *p = body.data() + ori_body_size;
+      ((p = detail::encode_to(p, data)), ...);
+
+      header.size = size();
+      return *this;
+    }
+
+    // 从 body 头部开始按写入顺序读取，不会修改 body
+    message_reader<T> reader() const
+    {
+      return message_reader<T>(*this);
+    }
+
     // print
     friend std::ostream &operator<<(std::ostream &os, const message &message)
     {
@@ -70,26 +311,15 @@ namespace net
      * example:
      * >>> message<T> msg;
      * >>> msg << 1 << 0 << "sdsd";
+     * 变长数据写入 varint 元素个数 + 内容，只能用 reader() 读取
+     * >>> msg << std::string("hello") << std::vector<float>{1.0f, 2.0f};
      **/
     template <typename DataType>
     friend message<T> &operator<<(message<T> &msg, const DataType &data)
     {
-      static_assert(std::is_standard_layout<DataType>::value, "Data is too complex and it cannot be serialized");
-
-      size_t ori_body_size = msg.body.size();
-
-      // increment body data size
-      size_t new_body_size = ori_body_size + sizeof(DataType);
-      msg.body.resize(new_body_size);
-
-      // .data() return start pointer
-      // + ori_body_size (offset) is the end pointer, &data return the data start pointer
-      std::memcpy(msg.body.data() + ori_body_size, &data, sizeof(DataType));
-
-      // recalculate the total message size
-      msg.header.size = msg.size();
-
-      return msg;
+      // 定长和变长数据都走 write（不能序列化的类型在 encoded_size 中 static_assert）：resize 之后一次 memcpy。使用 pool_allocator 时 insert 会逐个 byte 构造，走不到 memmove 的快速路径
+      // resize 填 0 的开销只有 sizeof(DataType) 个 byte，配合 reserve 同样不会重新分配内存；write 会重新计算 header.size
+      return msg.write(data);
     }
 
     /**
@@ -103,6 +333,7 @@ namespace net
     friend message<T> &operator>>(message<T> &msg, DataType &data)
     {
       static_assert(std::is_standard_layout<DataType>::value, "Data is too complex and it cannot be serialized");
+      static_assert(!detail::is_varlen<DataType>::value, "Variable-length data can only be read in order with reader()");
 
       size_t ori_body_size = msg.body.size();
 
@@ -120,6 +351,211 @@ namespace net
     }
   };
 
+  /**
+   * 消息的只读游标，从 body 头部开始按写入顺序读取，不会修改也不会拷贝 body，因此可以直接读取 const message
+   * 读取越界时不会读取任何数据，并且之后 ok() 返回 false
+   * example:
+   * >>> auto r = msg.reader();
+   * >>> float x, y;
+   * >>> r >> x >> y; // 或者 r.read(x, y);
+   * >>> if (!r) { ... }
+   * 变长数据：std::string_view、array_view、std::span（C++20，只支持 1 byte 的元素）直接指向 body 内部，不拷贝，只在 message 存活期间有效
+   * std::string、std::vector 拷贝一次
+   * >>> std::string_view text;
+   * >>> r >> userID >> text;
+   **/
+  template <typename T>
+  class message_reader
+  {
+  protected:
+    const uint8_t *data;
+    size_t size;
+    size_t offset = 0;
+    bool good = true;
+
+    // 读取 varint 元素个数，返回指向 count 个元素的指针，越界返回 nullptr
+    const uint8_t *read_array(size_t elementBytes, size_t &count)
+    {
+      uint64_t n;
+      if (!read_varint(n))
+        return nullptr;
+      if (n > remaining() / elementBytes)
+      {
+        good = false;
+        return nullptr;
+      }
+
+      count = size_t(n);
+      return read_bytes(count * elementBytes);
+    }
+
+    template <typename C, typename Traits, typename Alloc>
+    bool read_one(std::basic_string<C, Traits, Alloc> &out)
+    {
+      size_t count;
+      const uint8_t *p = read_array(sizeof(C), count);
+      if (p == nullptr)
+        return false;
+
+      out.resize(count);
+      if (count > 0)
+        std::memcpy(&out[0], p, count * sizeof(C));
+      return true;
+    }
+
+    template <typename C, typename Traits>
+    bool read_one(std::basic_string_view<C, Traits> &out)
+    {
+      static_assert(alignof(C) == 1, "Views into the body need 1-byte characters, read into std::basic_string instead");
+
+      size_t count;
+      const uint8_t *p = read_array(sizeof(C), count);
+      if (p == nullptr)
+        return false;
+
+      out = std::basic_string_view<C, Traits>(reinterpret_cast<const C *>(p), count);
+      return true;
+    }
+
+    template <typename E, typename Alloc>
+    bool read_one(std::vector<E, Alloc> &out)
+    {
+      static_assert(std::is_trivially_copyable<E>::value && !std::is_same<E, bool>::value, "Vector element is too complex and it cannot be serialized");
+
+      size_t count;
+      const uint8_t *p = read_array(sizeof(E), count);
+      if (p == nullptr)
+        return false;
+
+      out.resize(count);
+      if (count > 0)
+        std::memcpy(out.data(), p, count * sizeof(E));
+      return true;
+    }
+
+    template <typename E>
+    bool read_one(array_view<E> &out)
+    {
+      size_t count;
+      const uint8_t *p = read_array(sizeof(E), count);
+      if (p == nullptr)
+        return false;
+
+      out = array_view<E>(p, count);
+      return true;
+    }
+
+#if defined(__cpp_lib_span)
+    template <typename E, size_t Extent>
+    bool read_one(std::span<E, Extent> &out)
+    {
+      static_assert(std::is_const<E>::value && alignof(E) == 1 && Extent == std::dynamic_extent, "Views into the body need std::span<const E> with 1-byte elements, read into array_view instead");
+
+      size_t count;
+      const uint8_t *p = read_array(sizeof(E), count);
+      if (p == nullptr)
+        return false;
+
+      out = std::span<E>(reinterpret_cast<E *>(p), count);
+      return true;
+    }
+#endif
+
+    template <typename DataType>
+    bool read_one(DataType &out)
+    {
+      return read(out);
+    }
+
+  public:
+    explicit message_reader(const message<T> &msg) : data(msg.body.data()), size(msg.body.size()) {}
+
+    size_t remaining() const
+    {
+      return size - offset;
+    }
+
+    bool ok() const
+    {
+      return good;
+    }
+
+    explicit operator bool() const
+    {
+      return good;
+    }
+
+    // 一次读取多个数据，全部是定长数据时总大小在编译期计算，只做一次越界检查；有变长数据时逐个读取
+    template <typename... DataTypes>
+    bool read(DataTypes &...out)
+    {
+      static_assert(sizeof...(DataTypes) > 0, "Nothing to read");
+
+      if constexpr ((detail::is_varlen<DataTypes>::value || ...))
+      {
+        return (read_one(out) && ...);
+      }
+      else
+      {
+        static_assert((std::is_standard_layout<DataTypes>::value && ...), "Data is too complex and it cannot be serialized");
+
+        constexpr size_t total = (sizeof(DataTypes) + ...);
+        if (!good || remaining() < total)
+        {
+          good = false;
+          return false;
+        }
+
+        const uint8_t *p = data + offset;
+        ((std::memcpy(&out, p, sizeof(DataTypes)), p += sizeof(DataTypes)), ...);
+        offset += total;
+        return true;
+      }
+    }
+
+    // 读取 varint（LEB128），越界或超过 64 位时返回 false
+    bool read_varint(uint64_t &value)
+    {
+      uint64_t v = 0;
+      size_t i = offset;
+      for (unsigned shift = 0; good && i < size && shift < 64; shift += 7)
+      {
+        uint8_t b = data[i++];
+        v |= uint64_t(b & 0x7F) << shift;
+        if ((b & 0x80) == 0)
+        {
+          offset = i;
+          value = v;
+          return true;
+        }
+      }
+
+      good = false;
+      return false;
+    }
+
+    // 返回指向 body 内部的指针并跳过 n bytes，不拷贝，只在 message 存活期间有效，越界返回 nullptr
+    const uint8_t *read_bytes(size_t n)
+    {
+      if (!good || remaining() < n)
+      {
+        good = false;
+        return nullptr;
+      }
+
+      const uint8_t *p = data + offset;
+      offset += n;
+      return p;
+    }
+
+    template <typename DataType>
+    friend message_reader<T> &operator>>(message_reader<T> &r, DataType &out)
+    {
+      r.read(out);
+      return r;
+    }
+  };
+
   // Forward declarations only for pointer, 因为指针类型分配的大小的确定的
   template <typename T>
   class connection;
@@ -138,6 +574,10 @@ namespace net
      * 发送的消息
      */
     message<T> msg;
+    /**
+     * 放入接收队列的时间，用于统计消息在队列中等待的时间
+     */
+    std::chrono::steady_clock::time_point received{};
 
     // print
     friend std::ostream &operator<<(std::ostream &os, const owned_message<T> &msg)
@@ -146,4 +586,50 @@ namespace net
       return os;
     }
   };
+
+  /**
+   * 广播用的共享只读消息，所有连接的发送队列共享同一份 body，不会为每个连接拷贝一次
+   */
+  template <typename T>
+  using shared_message = std::shared_ptr<const message<T>>;
+
+  /**
+   * 一条广播消息压缩后的结果，同一条广播的所有连接共用
+   * 第一个需要压缩它的连接在自己的 I/O 线程中压缩，其余连接等待（call_once）之后直接引用结果，广播 N 个连接只压缩一次
+   */
+  template <typename T>
+  struct shared_compression
+  {
+    std::once_flag once;
+    // 压缩后没有变小时为空，按原样发送
+    shared_message<T> compressed = nullptr;
+  };
+
+  /**
+   * 发送队列中的消息，要么自己持有一份 message，要么引用一个共享的广播消息
+   */
+  template <typename T>
+  struct outgoing_message
+  {
+    message<T> msg;
+    shared_message<T> shared = nullptr;
+    // 广播消息共用的压缩结果，见 shared_compression
+    std::shared_ptr<shared_compression<T>> sharedCompression = nullptr;
+    // 调用 Send 的时间，用于统计消息在发送队列中等待的时间
+    std::chrono::steady_clock::time_point enqueued{};
+    // 是否是只关心最新值的消息，以及合并用的 key，见 coalesce_rules
+    bool coalescable = false;
+    uint64_t coalesceKey = 0;
+
+    outgoing_message() {}
+    outgoing_message(const message<T> &msg) : msg(msg) {}
+    outgoing_message(message<T> &&msg) : msg(std::move(msg)) {}
+    outgoing_message(shared_message<T> shared) : shared(std::move(shared)) {}
+
+    // 真正要发送的消息
+    const message<T> &get() const
+    {
+      return shared ? *shared : msg;
+    }
+  };
 }
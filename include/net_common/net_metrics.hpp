@@ -0,0 +1,212 @@
+#pragma once
+
+#include "net_histogram.hpp"
+#include <atomic>
+#include <vector>
+#include <utility>
+#include <stddef.h>
+#include <stdint.h>
+
+namespace net
+{
+  /**
+   * 直方图的摘要，单位和 Record 时一致（这里都是纳秒）
+   */
+  struct histogram_summary
+  {
+    uint64_t count = 0;
+    uint64_t p50 = 0;
+    uint64_t p99 = 0;
+    uint64_t p999 = 0;
+    uint64_t max = 0;
+
+    static histogram_summary From(const latency_histogram &h)
+    {
+      histogram_summary s;
+      s.count = h.Count();
+      s.p50 = h.Percentile(50);
+      s.p99 = h.Percentile(99);
+      s.p999 = h.Percentile(99.9);
+      s.max = h.Max();
+      return s;
+    }
+  };
+
+  struct connection_metrics_snapshot
+  {
+    uint32_t id = 0;
+    uint64_t bytesIn = 0;
+    uint64_t bytesOut = 0;
+    uint64_t messagesIn = 0;
+    uint64_t messagesOut = 0;
+    uint64_t readErrors = 0;
+    uint64_t writeErrors = 0;
+    uint64_t handshakeFailures = 0;
+    // 因为发送队列超过高水位而丢弃或者被合并的消息个数
+    uint64_t messagesDropped = 0;
+    // 被同 ID（和 key）的新消息替换掉的消息个数，见 coalesce_rules
+    uint64_t messagesCoalesced = 0;
+    // 不可靠通道（UDP）收发的数据报个数
+    uint64_t datagramsIn = 0;
+    uint64_t datagramsOut = 0;
+    // 已经调用 Send 但还没有写入 socket 的消息个数
+    uint64_t outQueueDepth = 0;
+
+    connection_metrics_snapshot &operator+=(const connection_metrics_snapshot &other)
+    {
+      bytesIn += other.bytesIn;
+      bytesOut += other.bytesOut;
+      messagesIn += other.messagesIn;
+      messagesOut += other.messagesOut;
+      readErrors += other.readErrors;
+      writeErrors += other.writeErrors;
+      handshakeFailures += other.handshakeFailures;
+      messagesDropped += other.messagesDropped;
+      messagesCoalesced += other.messagesCoalesced;
+      datagramsIn += other.datagramsIn;
+      datagramsOut += other.datagramsOut;
+      outQueueDepth += other.outQueueDepth;
+      return *this;
+    }
+  };
+
+  /**
+   * 单个连接的计数器
+   * 除了 outQueueDepth 的增加（任意线程调用 Send）和服务端数据报的计数（udp 通道的线程），其余都只在连接自己的 I/O 线程中写入，没有竞争
+   * 另一个线程可以随时调用 Snapshot() 读取
+   */
+  class connection_metrics
+  {
+  public:
+    std::atomic<uint64_t> bytesIn{0};
+    std::atomic<uint64_t> bytesOut{0};
+    std::atomic<uint64_t> messagesIn{0};
+    std::atomic<uint64_t> messagesOut{0};
+    std::atomic<uint64_t> readErrors{0};
+    std::atomic<uint64_t> writeErrors{0};
+    std::atomic<uint64_t> handshakeFailures{0};
+    std::atomic<uint64_t> messagesDropped{0};
+    std::atomic<uint64_t> messagesCoalesced{0};
+    std::atomic<uint64_t> datagramsIn{0};
+    std::atomic<uint64_t> datagramsOut{0};
+    std::atomic<uint64_t> outQueueDepth{0};
+
+    connection_metrics_snapshot Snapshot() const
+    {
+      connection_metrics_snapshot s;
+      s.bytesIn = bytesIn.load(std::memory_order_relaxed);
+      s.bytesOut = bytesOut.load(std::memory_order_relaxed);
+      s.messagesIn = messagesIn.load(std::memory_order_relaxed);
+      s.messagesOut = messagesOut.load(std::memory_order_relaxed);
+      s.readErrors = readErrors.load(std::memory_order_relaxed);
+      s.writeErrors = writeErrors.load(std::memory_order_relaxed);
+      s.handshakeFailures = handshakeFailures.load(std::memory_order_relaxed);
+      s.messagesDropped = messagesDropped.load(std::memory_order_relaxed);
+      s.messagesCoalesced = messagesCoalesced.load(std::memory_order_relaxed);
+      s.datagramsIn = datagramsIn.load(std::memory_order_relaxed);
+      s.datagramsOut = datagramsOut.load(std::memory_order_relaxed);
+      s.outQueueDepth = outQueueDepth.load(std::memory_order_relaxed);
+      return s;
+    }
+
+    // 累加一个快照，用于保存已经断开的连接的计数
+    void Add(const connection_metrics_snapshot &s)
+    {
+      bytesIn.fetch_add(s.bytesIn, std::memory_order_relaxed);
+      bytesOut.fetch_add(s.bytesOut, std::memory_order_relaxed);
+      messagesIn.fetch_add(s.messagesIn, std::memory_order_relaxed);
+      messagesOut.fetch_add(s.messagesOut, std::memory_order_relaxed);
+      readErrors.fetch_add(s.readErrors, std::memory_order_relaxed);
+      writeErrors.fetch_add(s.writeErrors, std::memory_order_relaxed);
+      handshakeFailures.fetch_add(s.handshakeFailures, std::memory_order_relaxed);
+      messagesDropped.fetch_add(s.messagesDropped, std::memory_order_relaxed);
+      messagesCoalesced.fetch_add(s.messagesCoalesced, std::memory_order_relaxed);
+      datagramsIn.fetch_add(s.datagramsIn, std::memory_order_relaxed);
+      datagramsOut.fetch_add(s.datagramsOut, std::memory_order_relaxed);
+    }
+  };
+
+  /**
+   * 按消息类型计数，消息 ID 小于 MaxTrackedIds 的分别计数，其余的计入 untracked
+   */
+  template <typename T>
+  class message_type_counter
+  {
+  public:
+    static constexpr size_t MaxTrackedIds = 256;
+
+    void Increment(T id, uint64_t n = 1)
+    {
+      size_t index = size_t(id);
+      if (index < MaxTrackedIds)
+        counts[index].fetch_add(n, std::memory_order_relaxed);
+      else
+        untracked.fetch_add(n, std::memory_order_relaxed);
+    }
+
+    // 只返回计数不为 0 的消息类型
+    std::vector<std::pair<T, uint64_t>> Snapshot() const
+    {
+      std::vector<std::pair<T, uint64_t>> result;
+      for (size_t i = 0; i < MaxTrackedIds; i++)
+      {
+        uint64_t n = counts[i].load(std::memory_order_relaxed);
+        if (n > 0)
+          result.emplace_back(T(i), n);
+      }
+      return result;
+    }
+
+    uint64_t Untracked() const
+    {
+      return untracked.load(std::memory_order_relaxed);
+    }
+
+  private:
+    std::atomic<uint64_t> counts[MaxTrackedIds] = {};
+    std::atomic<uint64_t> untracked{0};
+  };
+
+  template <typename T>
+  struct server_metrics_snapshot
+  {
+    uint64_t connectionsAccepted = 0;
+    uint64_t connectionsDenied = 0;
+    uint64_t connectionsClosed = 0;
+    size_t clientCount = 0;
+    // 接收队列中等待 Update() 处理的消息个数
+    size_t inQueueDepth = 0;
+    // 所有连接（包括已经断开的）的累计值，outQueueDepth 只统计当前的连接
+    connection_metrics_snapshot totals;
+    std::vector<std::pair<T, uint64_t>> messagesInByType;
+    std::vector<std::pair<T, uint64_t>> messagesOutByType;
+    // 消息在接收队列中等待 Update() 处理的时间（纳秒）
+    histogram_summary inQueueTime;
+    // 从调用 Send 到写入 socket 完成的时间（纳秒）
+    histogram_summary outQueueTime;
+    // 路由表中带类型的处理函数解码消息体失败的次数
+    uint64_t decodeFailures = 0;
+    // 每个连接的计数，只有 GetMetrics(true) 时才有
+    std::vector<connection_metrics_snapshot> connections;
+  };
+
+  /**
+   * 服务端的计数器，由 server_interface 持有
+   */
+  template <typename T>
+  class server_metrics
+  {
+  public:
+    std::atomic<uint64_t> connectionsAccepted{0};
+    std::atomic<uint64_t> connectionsDenied{0};
+    std::atomic<uint64_t> connectionsClosed{0};
+    // 已经断开的连接的累计计数
+    connection_metrics departed;
+    // 在 Update() 线程中计数
+    message_type_counter<T> messagesInByType;
+    // 在各个连接的 I/O 线程中写入完成时计数
+    message_type_counter<T> messagesOutByType;
+    latency_histogram inQueueTime;
+    latency_histogram outQueueTime;
+  };
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <unordered_map>
+#include <stddef.h>
+#include <stdint.h>
+
+namespace net
+{
+  template <typename T>
+  class connection;
+
+  /**
+   * 按连接 ID 索引的连接表
+   * - 所有连接紧凑地保存在 dense 数组中，广播时顺序遍历
+   * - indexOf 记录 ID 在 dense 中的下标，添加、查找、删除都是 O(1)
+   * - 删除时把最后一个连接移动到被删除的位置，连接的 shared_ptr 立刻释放
+   * - 本身不是线程安全的，由 server_interface 加锁访问
+   */
+  template <typename T>
+  class connection_registry
+  {
+  protected:
+    std::vector<std::shared_ptr<connection<T>>> dense;
+    std::unordered_map<uint32_t, size_t> indexOf;
+
+  public:
+    bool add(uint32_t id, std::shared_ptr<connection<T>> client)
+    {
+      if (indexOf.count(id) > 0)
+        return false;
+
+      indexOf.emplace(id, dense.size());
+      dense.emplace_back(std::move(client));
+      return true;
+    }
+
+    std::shared_ptr<connection<T>> find(uint32_t id) const
+    {
+      auto it = indexOf.find(id);
+      if (it == indexOf.end())
+        return nullptr;
+      return dense[it->second];
+    }
+
+    // 返回被删除的连接，不存在返回 nullptr
+    std::shared_ptr<connection<T>> remove(uint32_t id)
+    {
+      auto it = indexOf.find(id);
+      if (it == indexOf.end())
+        return nullptr;
+
+      size_t index = it->second;
+      indexOf.erase(it);
+
+      std::shared_ptr<connection<T>> client = std::move(dense[index]);
+      if (index != dense.size() - 1)
+      {
+        dense[index] = std::move(dense.back());
+        indexOf[dense[index]->GetID()] = index;
+      }
+      dense.pop_back();
+      return client;
+    }
+
+    size_t size() const
+    {
+      return dense.size();
+    }
+
+    void clear()
+    {
+      dense.clear();
+      indexOf.clear();
+    }
+
+    typename std::vector<std::shared_ptr<connection<T>>>::iterator begin()
+    {
+      return dense.begin();
+    }
+
+    typename std::vector<std::shared_ptr<connection<T>>>::iterator end()
+    {
+      return dense.end();
+    }
+  };
+}
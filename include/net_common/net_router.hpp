@@ -0,0 +1,384 @@
+#pragma once
+
+#include "net_message.hpp"
+#include "net_schema.hpp"
+#include "net_lfqueue.hpp"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <memory>
+#include <thread>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+#include <stddef.h>
+#include <stdint.h>
+
+namespace net
+{
+  /**
+   * 把消息体解码为处理函数需要的类型
+   * 声明了 schema 的结构体用 read_schema，其余（定长数据、std::string、std::string_view 等变长数据）用 message_reader::read
+   * std::string_view、array_view 指向 msg 的 body，只在处理函数中有效
+   */
+  template <typename T, typename Payload>
+  bool decode_payload(const message<T> &msg, Payload &payload)
+  {
+    auto r = msg.reader();
+    if constexpr (has_schema<Payload>::value)
+      return read_schema(r, payload);
+    else
+      return r.read(payload);
+  }
+
+  namespace detail
+  {
+    // 从处理函数 (client, payload) 的签名中取出 payload 的类型，支持 lambda、函数指针和成员函数指针
+    template <typename F>
+    struct route_handler_traits : route_handler_traits<decltype(&F::operator())>
+    {
+    };
+
+    template <typename R, typename Client, typename Arg>
+    struct route_handler_traits<R (*)(Client, Arg)>
+    {
+      using payload = std::decay_t<Arg>;
+    };
+
+    template <typename C, typename R, typename Client, typename Arg>
+    struct route_handler_traits<R (C::*)(Client, Arg)>
+    {
+      using payload = std::decay_t<Arg>;
+    };
+
+    template <typename C, typename R, typename Client, typename Arg>
+    struct route_handler_traits<R (C::*)(Client, Arg) const>
+    {
+      using payload = std::decay_t<Arg>;
+    };
+
+    // 显式指定了 Payload 时不再从签名推导（泛型 lambda 无法推导）
+    template <typename Payload, typename F>
+    struct route_payload
+    {
+      using type = Payload;
+    };
+
+    template <typename F>
+    struct route_payload<void, F>
+    {
+      using type = typename route_handler_traits<F>::payload;
+    };
+  }
+
+  /**
+   * 按消息 ID 分发的路由表，代替在 OnMessage 中 switch msg.header.id
+   * - ID 小于 MaxDenseIds 的处理函数保存在以 ID 为下标的数组中（跳转表），分发时一次下标访问；更大的 ID 放在 unordered_map 中
+   * - 处理函数可以直接接收 message，也可以接收解码好的 payload（见 decode_payload），解码失败的消息不会进入处理函数，计入 DecodeFailures()
+   * - 每个 ID 可以指定一个工作线程（从 0 开始的编号），消息会移动到该线程的队列中，在该线程中按顺序处理；默认在调用 Dispatch 的线程中直接处理
+   * - 注册（On）需要在 StartWorkers() 和开始分发之前完成，之后路由表只读，不需要加锁
+   * example:
+   * >>> router.On(MsgType::Ping, [](const auto &client, const net::message<MsgType> &msg) { ... });
+   * >>> router.On(MsgType::Move, [](const std::shared_ptr<net::connection<MsgType>> &client, const PlayerMove &move) { ... });
+   * >>> router.On<std::string_view>(MsgType::Chat, [](const auto &client, std::string_view text) { ... }, 0);
+   **/
+  template <typename T>
+  class message_router
+  {
+  public:
+    using client_ptr = std::shared_ptr<connection<T>>;
+    // 分发时调用的函数指针，context 指向注册的处理函数对象
+    using invoker = void (*)(void *context, const client_ptr &, const message<T> &);
+
+    // 不指定工作线程，在调用 Dispatch 的线程中处理
+    static constexpr size_t InlineWorker = size_t(-1);
+    // 跳转表的最大长度
+    static constexpr size_t MaxDenseIds = 4096;
+
+  protected:
+    /**
+     * 处理函数擦除类型后保存为函数指针 + 上下文，分发时只有一次间接调用，不经过 std::function 的包装
+     * 处理函数对象在 Add 时分配一次，由 handlers 持有；entry 只有 24 bytes，跳转表更紧凑
+     */
+    struct entry
+    {
+      invoker invoke = nullptr;
+      void *context = nullptr;
+      size_t worker = InlineWorker;
+    };
+
+    struct worker_state
+    {
+      inbound_queue<owned_message<T>> queue;
+      pooled_deque<owned_message<T>> batch;
+      std::thread thread;
+    };
+
+    std::vector<entry> dense;
+    // 所有注册过的处理函数对象，同一个 id 重复注册时旧的也保留到析构，注册只在启动前进行，数量有限
+    std::vector<std::shared_ptr<void>> handlers;
+    std::unordered_map<uint64_t, entry> sparse;
+    std::vector<std::unique_ptr<worker_state>> workers;
+    std::atomic<bool> running{false};
+    std::atomic<uint64_t> decodeFailures{0};
+
+    const entry *Find(T id) const
+    {
+      size_t index = size_t(id);
+      if (index < dense.size())
+        return dense[index].invoke != nullptr ? &dense[index] : nullptr;
+
+      auto it = sparse.find(uint64_t(id));
+      return it == sparse.end() ? nullptr : &it->second;
+    }
+
+    template <typename F>
+    static void Invoke(void *context, const client_ptr &client, const message<T> &msg)
+    {
+      (*static_cast<F *>(context))(client, msg);
+    }
+
+    template <typename F>
+    void Add(T id, F &&fn, size_t worker)
+    {
+      auto handler = std::make_shared<std::decay_t<F>>(std::forward<F>(fn));
+      entry e{&Invoke<std::decay_t<F>>, handler.get(), worker};
+      handlers.emplace_back(std::move(handler));
+
+      if (worker != InlineWorker)
+      {
+        while (workers.size() <= worker)
+          workers.emplace_back(std::make_unique<worker_state>());
+      }
+
+      size_t index = size_t(id);
+      if (index < MaxDenseIds)
+      {
+        if (index >= dense.size())
+          dense.resize(index + 1);
+        dense[index] = std::move(e);
+      }
+      else
+        sparse[uint64_t(id)] = std::move(e);
+    }
+
+  public:
+    message_router() = default;
+    message_router(const message_router &) = delete;
+    message_router &operator=(const message_router &) = delete;
+
+    ~message_router()
+    {
+      StopWorkers();
+    }
+
+    /**
+     * 注册 id 的处理函数，同一个 id 重复注册时替换之前的
+     * - f(client, const message<T> &)：直接处理消息
+     * - f(client, const Payload &)：先解码为 Payload，Payload 从 f 的签名推导；f 是泛型 lambda 时需要显式指定 On<Payload>(...)
+     * worker 为工作线程的编号，InlineWorker 表示在调用 Dispatch 的线程中处理
+     */
+    template <typename Payload = void, typename F>
+    void On(T id, F &&f, size_t worker = InlineWorker)
+    {
+      if constexpr (std::is_void<Payload>::value && std::is_invocable<F &, const client_ptr &, const message<T> &>::value)
+      {
+        Add(id, std::forward<F>(f), worker);
+      }
+      else
+      {
+        using payload = typename detail::route_payload<Payload, std::decay_t<F>>::type;
+        Add(id, [this, f = std::forward<F>(f)](const client_ptr &client, const message<T> &msg) mutable
+            {
+              payload p{};
+              if (!decode_payload(msg, p))
+              {
+                decodeFailures.fetch_add(1, std::memory_order_relaxed);
+                return;
+              }
+              f(client, p); },
+            worker);
+      }
+    }
+
+    bool Contains(T id) const
+    {
+      return Find(id) != nullptr;
+    }
+
+    /**
+     * 分发一条消息，没有注册的 ID 返回 false，消息保持不变
+     * 指定了工作线程的消息会被移动到该线程的队列中
+     */
+    bool Dispatch(owned_message<T> &owned)
+    {
+      const entry *e = Find(owned.msg.header.id);
+      if (e == nullptr)
+        return false;
+
+      if (e->worker == InlineWorker)
+        e->invoke(e->context, owned.remote, owned.msg);
+      else
+        workers[e->worker]->queue.emplace_back(std::move(owned));
+      return true;
+    }
+
+    // 不经过工作线程，直接在当前线程中处理
+    bool Dispatch(const client_ptr &client, const message<T> &msg)
+    {
+      const entry *e = Find(msg.header.id);
+      if (e == nullptr)
+        return false;
+
+      e->invoke(e->context, client, msg);
+      return true;
+    }
+
+    /**
+     * 启动所有工作线程，pollInterval 是检查停止标记的间隔，只影响 StopWorkers() 返回的快慢
+     */
+    void StartWorkers(std::chrono::steady_clock::duration pollInterval = std::chrono::milliseconds(100))
+    {
+      if (running.exchange(true))
+        return;
+
+      for (auto &w : workers)
+      {
+        worker_state *state = w.get();
+        state->thread = std::thread([this, state, pollInterval]()
+                                    {
+          while (running)
+          {
+            if (!state->queue.wait_for(pollInterval))
+              continue;
+
+            state->queue.pop_front_batch(state->batch, size_t(-1));
+            while (!state->batch.empty())
+            {
+              owned_message<T> &owned = state->batch.front();
+              const entry *e = Find(owned.msg.header.id);
+              e->invoke(e->context, owned.remote, owned.msg);
+              state->batch.pop_front();
+            }
+          } });
+      }
+    }
+
+    // 等待工作线程处理完当前这一批消息后退出，队列中剩下的消息不再处理
+    void StopWorkers()
+    {
+      running = false;
+      for (auto &w : workers)
+      {
+        if (w->thread.joinable())
+          w->thread.join();
+      }
+    }
+
+    size_t WorkerCount() const
+    {
+      return workers.size();
+    }
+
+    // 工作线程是否在运行（StartWorkers() 之后、StopWorkers() 之前）
+    bool Running() const
+    {
+      return running.load();
+    }
+
+    uint64_t DecodeFailures() const
+    {
+      return decodeFailures.load(std::memory_order_relaxed);
+    }
+  };
+
+  // static_router 的一条路由：消息 ID 和处理它的成员函数
+  template <auto Id, auto Handler>
+  struct route
+  {
+    static constexpr auto id = Id;
+    static constexpr auto handler = Handler;
+  };
+
+  /**
+   * 编译期确定的路由表，处理函数是服务端类的成员函数，跳转表在编译期生成
+   * 处理函数的签名为 (client, const message<T> &) 或 (client, const Payload &)，后者先用 decode_payload 解码
+   * 没有注册的 ID 或者解码失败时 Dispatch 返回 false
+   * example:
+   * >>> using routes = net::static_router<net::route<MsgType::Ping, &MyServer::OnPing>, net::route<MsgType::Move, &MyServer::OnMove>>;
+   * >>> virtual void OnMessage(std::shared_ptr<net::connection<MsgType>> client, const net::message<MsgType> &msg)
+   * >>> {
+   * >>>   routes::Dispatch(*this, client, msg);
+   * >>> }
+   **/
+  template <typename... Routes>
+  class static_router
+  {
+    static_assert(sizeof...(Routes) > 0, "No routes");
+
+  public:
+    static constexpr size_t MaxIds = 4096;
+    static constexpr size_t TableSize = std::max({size_t(Routes::id)...}) + 1;
+    static_assert(TableSize <= MaxIds, "Message IDs are too large for a static jump table, use message_router");
+
+  protected:
+    static constexpr bool UniqueIds()
+    {
+      constexpr size_t ids[] = {size_t(Routes::id)...};
+      for (size_t i = 0; i < sizeof...(Routes); i++)
+      {
+        for (size_t j = i + 1; j < sizeof...(Routes); j++)
+        {
+          if (ids[i] == ids[j])
+            return false;
+        }
+      }
+      return true;
+    }
+    static_assert(UniqueIds(), "Duplicate message ID in static_router");
+
+    template <typename Owner, typename T, typename Route>
+    static bool Invoke(Owner &owner, const std::shared_ptr<connection<T>> &client, const message<T> &msg)
+    {
+      using payload = typename detail::route_handler_traits<std::decay_t<decltype(Route::handler)>>::payload;
+      if constexpr (std::is_same<payload, message<T>>::value)
+      {
+        (owner.*Route::handler)(client, msg);
+      }
+      else
+      {
+        payload p{};
+        if (!decode_payload(msg, p))
+          return false;
+        (owner.*Route::handler)(client, p);
+      }
+      return true;
+    }
+
+    template <typename Owner, typename T>
+    using thunk = bool (*)(Owner &, const std::shared_ptr<connection<T>> &, const message<T> &);
+
+    template <typename Owner, typename T>
+    static constexpr std::array<thunk<Owner, T>, TableSize> BuildTable()
+    {
+      std::array<thunk<Owner, T>, TableSize> table{};
+      ((table[size_t(Routes::id)] = &Invoke<Owner, T, Routes>), ...);
+      return table;
+    }
+
+    template <typename Owner, typename T>
+    static constexpr std::array<thunk<Owner, T>, TableSize> table = BuildTable<Owner, T>();
+
+  public:
+    template <typename Owner, typename T>
+    static bool Dispatch(Owner &owner, const std::shared_ptr<connection<T>> &client, const message<T> &msg)
+    {
+      size_t index = size_t(msg.header.id);
+      if (index >= TableSize || table<Owner, T>[index] == nullptr)
+        return false;
+      return table<Owner, T>[index](owner, client, msg);
+    }
+  };
+}
@@ -0,0 +1,350 @@
+#pragma once
+
+#include "net_message.hpp"
+#include <array>
+#include <cstring>
+#include <type_traits>
+#include <stddef.h>
+#include <stdint.h>
+
+// 主机字节序，线上格式固定为小端
+#if defined(__BYTE_ORDER__) && defined(__ORDER_BIG_ENDIAN__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#define NET_BIG_ENDIAN 1
+#else
+#define NET_BIG_ENDIAN 0
+#endif
+
+namespace net
+{
+  /**
+   * 定长消息体的声明：特化 schema<S>，按顺序列出要传输的字段
+   * - 线上格式为各字段按列出的顺序紧密排列（没有填充），数值都是小端，和主机的字节序、结构体的对齐无关
+   * - 字段可以是整数、浮点、bool、枚举，它们的定长数组（C 数组或 std::array），以及同样声明了 schema 的结构体
+   * - WireBytes 是编译期常量，用 static_assert 固定下来，改了字段忘记同步另一端时编译失败
+   * - 读取只消费 WireBytes bytes，因此新字段只能加在最后，老版本的接收方会忽略多出来的部分
+   * example:
+   * >>> struct PlayerMove { uint32_t id; float x, y; uint16_t hp; uint16_t flags; };
+   * >>> template <>
+   * >>> struct net::schema<PlayerMove> : net::schema_fields<&PlayerMove::id, &PlayerMove::x, &PlayerMove::y, &PlayerMove::hp, &PlayerMove::flags> {};
+   * >>> static_assert(net::schema<PlayerMove>::WireBytes == 16, "PlayerMove wire format changed");
+   * >>> net::write_schema(msg, move);
+   * >>> auto r = msg.reader();
+   * >>> net::read_schema(r, move);
+   **/
+  template <typename S>
+  struct schema;
+
+  template <typename S, typename = void>
+  struct has_schema : std::false_type
+  {
+  };
+
+  template <typename S>
+  struct has_schema<S, std::void_t<decltype(schema<S>::WireBytes)>> : std::true_type
+  {
+  };
+
+  namespace detail
+  {
+    template <size_t Bytes>
+    struct wire_uint;
+    template <>
+    struct wire_uint<1>
+    {
+      using type = uint8_t;
+    };
+    template <>
+    struct wire_uint<2>
+    {
+      using type = uint16_t;
+    };
+    template <>
+    struct wire_uint<4>
+    {
+      using type = uint32_t;
+    };
+    template <>
+    struct wire_uint<8>
+    {
+      using type = uint64_t;
+    };
+
+    template <typename U>
+    inline U byteswap(U v)
+    {
+      U out = 0;
+      for (size_t i = 0; i < sizeof(U); i++)
+      {
+        out = U((out << 8) | (v & 0xFF));
+        v = U(v >> 8);
+      }
+      return out;
+    }
+
+    /**
+     * 单个字段的编码
+     * Bytes 为线上的 bytes，Plain 表示小端主机上内存中的表示和线上格式完全相同，可以直接 memcpy
+     */
+    template <typename F, typename = void>
+    struct wire_field
+    {
+      static_assert(sizeof(F) == 0, "Field type is not supported by net::schema, declare a schema for it");
+    };
+
+    template <typename F>
+    struct wire_field<F, std::enable_if_t<std::is_arithmetic<F>::value>>
+    {
+      static_assert(sizeof(F) == 1 || sizeof(F) == 2 || sizeof(F) == 4 || sizeof(F) == 8, "Field size must be 1, 2, 4 or 8 bytes");
+
+      static constexpr size_t Bytes = sizeof(F);
+      static constexpr bool Plain = true;
+
+      static void Encode(const F &v, uint8_t *p)
+      {
+#if NET_BIG_ENDIAN
+        typename wire_uint<sizeof(F)>::type u;
+        std::memcpy(&u, &v, sizeof(F));
+        u = byteswap(u);
+        std::memcpy(p, &u, sizeof(F));
+#else
+        std::memcpy(p, &v, sizeof(F));
+#endif
+      }
+
+      static void Decode(F &v, const uint8_t *p)
+      {
+#if NET_BIG_ENDIAN
+        typename wire_uint<sizeof(F)>::type u;
+        std::memcpy(&u, p, sizeof(F));
+        u = byteswap(u);
+        std::memcpy(&v, &u, sizeof(F));
+#else
+        std::memcpy(&v, p, sizeof(F));
+#endif
+      }
+    };
+
+    // 枚举按底层整数类型传输
+    template <typename F>
+    struct wire_field<F, std::enable_if_t<std::is_enum<F>::value>>
+    {
+      using underlying = std::underlying_type_t<F>;
+
+      static constexpr size_t Bytes = sizeof(underlying);
+      static constexpr bool Plain = true;
+
+      static void Encode(const F &v, uint8_t *p)
+      {
+        wire_field<underlying>::Encode(static_cast<underlying>(v), p);
+      }
+
+      static void Decode(F &v, const uint8_t *p)
+      {
+        underlying u;
+        wire_field<underlying>::Decode(u, p);
+        v = static_cast<F>(u);
+      }
+    };
+
+    template <typename F, size_t N>
+    struct wire_array
+    {
+      static constexpr size_t Bytes = wire_field<F>::Bytes * N;
+      static constexpr bool Plain = wire_field<F>::Plain && sizeof(F) == wire_field<F>::Bytes;
+
+      static void Encode(const F *v, uint8_t *p)
+      {
+        for (size_t i = 0; i < N; i++, p += wire_field<F>::Bytes)
+          wire_field<F>::Encode(v[i], p);
+      }
+
+      static void Decode(F *v, const uint8_t *p)
+      {
+        for (size_t i = 0; i < N; i++, p += wire_field<F>::Bytes)
+          wire_field<F>::Decode(v[i], p);
+      }
+    };
+
+    template <typename F, size_t N>
+    struct wire_field<F[N]>
+    {
+      static constexpr size_t Bytes = wire_array<F, N>::Bytes;
+      static constexpr bool Plain = wire_array<F, N>::Plain;
+
+      static void Encode(const F (&v)[N], uint8_t *p)
+      {
+        wire_array<F, N>::Encode(v, p);
+      }
+
+      static void Decode(F (&v)[N], const uint8_t *p)
+      {
+        wire_array<F, N>::Decode(v, p);
+      }
+    };
+
+    template <typename F, size_t N>
+    struct wire_field<std::array<F, N>>
+    {
+      static constexpr size_t Bytes = wire_array<F, N>::Bytes;
+      static constexpr bool Plain = wire_array<F, N>::Plain && sizeof(std::array<F, N>) == Bytes;
+
+      static void Encode(const std::array<F, N> &v, uint8_t *p)
+      {
+        wire_array<F, N>::Encode(v.data(), p);
+      }
+
+      static void Decode(std::array<F, N> &v, const uint8_t *p)
+      {
+        wire_array<F, N>::Decode(v.data(), p);
+      }
+    };
+
+    // 嵌套的结构体用它自己的 schema 编码
+    template <typename F>
+    struct wire_field<F, std::enable_if_t<has_schema<F>::value>>
+    {
+      static constexpr size_t Bytes = schema<F>::WireBytes;
+      static constexpr bool Plain = false;
+
+      static void Encode(const F &v, uint8_t *p)
+      {
+        schema<F>::Encode(v, p);
+      }
+
+      static void Decode(F &v, const uint8_t *p)
+      {
+        schema<F>::Decode(v, p);
+      }
+    };
+
+    template <typename M>
+    struct member_traits;
+
+    template <typename C, typename F>
+    struct member_traits<F C::*>
+    {
+      using owner = C;
+      using type = F;
+    };
+  }
+
+  /**
+   * schema<S> 的实现，模板参数为字段的成员指针
+   * 小端主机上，结构体没有填充、字段按声明顺序全部列出时，内存布局就是线上格式，整个结构体一次 memcpy；否则逐个字段编码
+   */
+  template <auto First, auto... Rest>
+  struct schema_fields
+  {
+    using owner = typename detail::member_traits<decltype(First)>::owner;
+    static_assert((std::is_same<owner, typename detail::member_traits<decltype(Rest)>::owner>::value && ...), "All fields must be members of the same struct");
+
+    static constexpr size_t WireBytes = (detail::wire_field<typename detail::member_traits<decltype(First)>::type>::Bytes + ... + detail::wire_field<typename detail::member_traits<decltype(Rest)>::type>::Bytes);
+
+    // 编译期能确定的条件，字段顺序还要在 LayoutMatches() 中检查一次
+    static constexpr bool MaybeMemcpy = !NET_BIG_ENDIAN && std::is_trivially_copyable<owner>::value && std::is_default_constructible<owner>::value &&
+                                        sizeof(owner) == WireBytes &&
+                                        detail::wire_field<typename detail::member_traits<decltype(First)>::type>::Plain &&
+                                        (detail::wire_field<typename detail::member_traits<decltype(Rest)>::type>::Plain && ...);
+
+    // 每个字段在结构体中的偏移是否等于它在线上格式中的偏移
+    static bool LayoutMatches()
+    {
+      owner probe{};
+      const uint8_t *base = reinterpret_cast<const uint8_t *>(&probe);
+      size_t wireOffset = 0;
+      bool ok = true;
+      auto check = [&](const auto &field)
+      {
+        ok = ok && reinterpret_cast<const uint8_t *>(&field) - base == ptrdiff_t(wireOffset);
+        wireOffset += detail::wire_field<std::remove_cv_t<std::remove_reference_t<decltype(field)>>>::Bytes;
+      };
+      check(probe.*First);
+      (check(probe.*Rest), ...);
+      return ok;
+    }
+
+    // p 指向 WireBytes bytes 的空间
+    static void Encode(const owner &v, uint8_t *p)
+    {
+      if constexpr (MaybeMemcpy)
+      {
+        if (useMemcpy)
+        {
+          std::memcpy(p, &v, WireBytes);
+          return;
+        }
+      }
+      EncodeField(v.*First, p);
+      (EncodeField(v.*Rest, p), ...);
+    }
+
+    static void Decode(owner &v, const uint8_t *p)
+    {
+      if constexpr (MaybeMemcpy)
+      {
+        if (useMemcpy)
+        {
+          std::memcpy(&v, p, WireBytes);
+          return;
+        }
+      }
+      DecodeField(v.*First, p);
+      (DecodeField(v.*Rest, p), ...);
+    }
+
+  private:
+    /**
+     * 程序启动时计算一次，之后每次编码只读一个 bool，没有局部静态变量的初始化检查
+     * 其他全局对象的构造函数中使用时可能还没有计算，此时为 false，退回逐个字段编码，结果相同
+     */
+    static inline const bool useMemcpy = []()
+    {
+      if constexpr (MaybeMemcpy)
+        return LayoutMatches();
+      else
+        return false;
+    }();
+
+    template <typename F>
+    static void EncodeField(const F &field, uint8_t *&p)
+    {
+      detail::wire_field<F>::Encode(field, p);
+      p += detail::wire_field<F>::Bytes;
+    }
+
+    template <typename F>
+    static void DecodeField(F &field, const uint8_t *&p)
+    {
+      detail::wire_field<F>::Decode(field, p);
+      p += detail::wire_field<F>::Bytes;
+    }
+  };
+
+  // 按 schema 编码后追加到 body 尾部，body 只 resize 一次
+  template <typename T, typename S>
+  message<T> &write_schema(message<T> &msg, const S &value)
+  {
+    static_assert(has_schema<S>::value, "No net::schema specialization for this type");
+
+    size_t ori_body_size = msg.body.size();
+    msg.body.resize(ori_body_size + schema<S>::WireBytes);
+    schema<S>::Encode(value, msg.body.data() + ori_body_size);
+
+    msg.header.size = msg.size();
+    return msg;
+  }
+
+  // 从游标处按 schema 解码，剩余不足 WireBytes 时返回 false，value 不会被修改
+  template <typename T, typename S>
+  bool read_schema(message_reader<T> &r, S &value)
+  {
+    static_assert(has_schema<S>::value, "No net::schema specialization for this type");
+
+    const uint8_t *p = r.read_bytes(schema<S>::WireBytes);
+    if (p == nullptr)
+      return false;
+
+    schema<S>::Decode(value, p);
+    return true;
+  }
+}
@@ -1,25 +1,171 @@
 #pragma once
 
 #include "net_tsqueue.hpp"
+#include "net_lfqueue.hpp"
 #include "net_connection.hpp"
 #include "net_message.hpp"
+#include "net_context_pool.hpp"
+#include "net_registry.hpp"
+#include "net_groups.hpp"
+#include "net_metrics.hpp"
+#include "net_udp.hpp"
+#include "net_log.hpp"
+#include "net_router.hpp"
+#include <chrono>
+#include <deque>
+#include <exception>
 #include <iostream>
+#include <mutex>
+#include <memory>
+#include <vector>
 
 namespace net
 {
+#if defined(SO_REUSEPORT)
+  // 多个 socket 绑定同一个端口，由内核把新连接分配给其中一个
+  using reuse_port = asio::detail::socket_option::boolean<SOL_SOCKET, SO_REUSEPORT>;
+#endif
+
   template <typename T>
   class server_interface
   {
   public:
-    server_interface(std::uint16_t port) : m_acceptor(ctx, asio::ip::tcp::endpoint(asio::ip::tcp::v4(), port)) {}
+    /**
+     * nThreads 为 I/O 线程数，每个线程一个 io_context
+     * - 默认只有一个 acceptor（在 m_ctx_pool[0] 上），新连接轮询分配到各个 io_context 上
+     * - sharded 为 true 时每个 I/O 线程都有自己的 acceptor（SO_REUSEPORT），由内核分配新连接，accept、验证和读写都在同一个线程中，
+     *   每个线程还有自己的连接表分片，accept 的吞吐量随核数增加；不支持 SO_REUSEPORT 的平台退回到单个 acceptor
+     */
+    server_interface(std::uint16_t port, size_t nThreads = 1, bool sharded = false) : m_ctx_pool(nThreads), m_udp(m_ctx_pool[0]), m_port(port)
+    {
+      asio::ip::tcp::endpoint endpoint(asio::ip::tcp::v4(), port);
+#if defined(SO_REUSEPORT)
+      if (sharded && m_ctx_pool.size() > 1)
+      {
+        for (size_t i = 0; i < m_ctx_pool.size(); i++)
+        {
+          auto acceptor = std::make_unique<asio::ip::tcp::acceptor>(m_ctx_pool[i]);
+          acceptor->open(endpoint.protocol());
+          acceptor->set_option(asio::ip::tcp::acceptor::reuse_address(true));
+          acceptor->set_option(reuse_port(true));
+          acceptor->bind(endpoint);
+          acceptor->listen();
+          m_acceptors.emplace_back(std::move(acceptor));
+        }
+      }
+#else
+      if (sharded)
+        NET_LOG_WARN("[SERVER] SO_REUSEPORT Not Supported, Use Single Acceptor");
+#endif
+      if (m_acceptors.empty())
+        m_acceptors.emplace_back(std::make_unique<asio::ip::tcp::acceptor>(m_ctx_pool[0], endpoint));
+
+      // 每个 acceptor 一个连接表分片，分片 i 分配的 ID 为 10000 + i + k * 分片数
+      for (size_t i = 0; i < m_acceptors.size(); i++)
+      {
+        m_shards.emplace_back(std::make_unique<connection_shard>());
+        m_shards.back()->nextID = uint32_t(10000 + i);
+      }
+    }
     virtual ~server_interface()
     {
+      // 工作线程会调用派生类注册的处理函数，到这里派生类的成员已经析构了，派生类的析构函数中必须先调用 Stop()
+      // 这时再停止工作线程已经晚了（正在执行的处理函数可能访问已经析构的成员），release 版本也直接终止，而不是留下难以复现的崩溃
+      // 日志是异步输出的，终止前可能来不及写出，所以直接写 std::cerr
+      if (m_router.WorkerCount() > 0 && m_router.Running())
+      {
+        std::cerr << "[SERVER] Router workers are still running in ~server_interface, call Stop() in the derived server's destructor" << std::endl;
+        std::terminate();
+      }
       Stop();
     }
 
-    uint16_t ClientCount() const
+    size_t ClientCount()
+    {
+      size_t count = 0;
+      for (auto &shard : m_shards)
+      {
+        std::lock_guard<std::mutex> lock(shard->mutex);
+        count += shard->connections.size();
+      }
+      return count;
+    }
+
+    // 服务端计数器，connection 在 I/O 线程中直接更新
+    server_metrics<T> &Metrics()
+    {
+      return m_metrics;
+    }
+
+    /**
+     * 服务端计数的快照，可以在单独的监控线程中定期调用
+     * includeConnections 为 true 时同时返回每个连接的计数，用来找出发送队列堆积的慢客户端
+     */
+    server_metrics_snapshot<T> GetMetrics(bool includeConnections = false)
+    {
+      server_metrics_snapshot<T> s;
+      s.connectionsAccepted = m_metrics.connectionsAccepted.load(std::memory_order_relaxed);
+      s.connectionsDenied = m_metrics.connectionsDenied.load(std::memory_order_relaxed);
+      s.connectionsClosed = m_metrics.connectionsClosed.load(std::memory_order_relaxed);
+      s.inQueueDepth = message_in_dq.count();
+      s.totals = m_metrics.departed.Snapshot();
+      s.messagesInByType = m_metrics.messagesInByType.Snapshot();
+      s.messagesOutByType = m_metrics.messagesOutByType.Snapshot();
+      s.inQueueTime = histogram_summary::From(m_metrics.inQueueTime);
+      s.outQueueTime = histogram_summary::From(m_metrics.outQueueTime);
+      s.decodeFailures = m_router.DecodeFailures();
+
+      ForEachClient([&](const std::shared_ptr<connection<T>> &client)
+                    {
+        connection_metrics_snapshot c = client->GetMetrics();
+        s.clientCount++;
+        s.totals += c;
+        if (includeConnections)
+          s.connections.emplace_back(c); });
+      return s;
+    }
+
+    // 设置新连接的发送队列水位和策略，已经建立的连接可以通过 connection::SetBackpressure 单独设置
+    void SetBackpressure(const backpressure_config &config)
+    {
+      m_backpressure = config;
+    }
+
+    /**
+     * 把消息类型标记为只关心最新值，之后新连接的发送队列中，新消息会替换还没发送的、ID 和 key 相同的旧消息
+     * key 为空时同一个 ID 只保留最新的一条，见 coalesce_rules，需要在 Start() 之前调用
+     */
+    void SetCoalescable(T id, typename coalesce_rules<T>::key_function key = nullptr)
+    {
+      // 已经建立的连接还持有旧的规则，这里复制一份再修改
+      auto rules = m_coalesce ? std::make_shared<coalesce_rules<T>>(*m_coalesce) : std::make_shared<coalesce_rules<T>>();
+      rules->Add(id, std::move(key));
+      m_coalesce = std::move(rules);
+    }
+
+    // 消息体不小于 minBytes 的该类型消息在发送前压缩，对新连接生效，需要在 Start() 之前调用
+    void SetCompressible(T id, size_t minBytes = 256)
+    {
+      auto rules = m_compression ? std::make_shared<compression_rules<T>>(*m_compression) : std::make_shared<compression_rules<T>>();
+      rules->Add(id, minBytes);
+      m_compression = std::move(rules);
+    }
+
+    /**
+     * 在同一个端口上开启不可靠通道（UDP），需要在 Start() 之前调用
+     * 客户端也开启后，验证通过的连接可以用 connection::SendUnreliable 收发数据报，收到的数据报和 TCP 消息一样进入 OnMessage
+     */
+    void EnableUnreliableChannel()
+    {
+      m_unreliable = true;
+    }
+
+    // 按 ID 查找连接，不存在返回 nullptr
+    std::shared_ptr<connection<T>> GetClient(uint32_t id)
     {
-      return m_connections_dq.size();
+      connection_shard &shard = ShardOf(id);
+      std::lock_guard<std::mutex> lock(shard.mutex);
+      return shard.connections.find(id);
     }
 
     bool Start()
@@ -27,146 +173,384 @@ namespace net
       try
       {
         // 一直循环监听
-        WaitForClientConnection();
+        for (size_t i = 0; i < m_acceptors.size(); i++)
+          WaitForClientConnection(i);
+
+        if (m_unreliable)
+          m_udp.Open(asio::ip::udp::endpoint(asio::ip::udp::v4(), m_port), [this](const udp_header &header, message<T> &&msg, const asio::ip::udp::endpoint &from)
+                     { OnDatagram(header, std::move(msg), from); });
 
-        ctx_thread = std::thread([this]()
-                                 { ctx.run(); });
+        m_ctx_pool.Run();
+        m_router.StartWorkers();
 
-        std::cout << "[SERVER] Started!" << std::endl;
+        NET_LOG_INFO("[SERVER] Started! I/O threads: " << m_ctx_pool.size() << ", acceptors: " << m_acceptors.size());
         return true;
       }
       catch (const std::exception &e)
       {
-        std::cerr << "[SERVER] Exception: " << e.what() << std::endl;
+        NET_LOG_ERROR("[SERVER] Exception: " << e.what());
         return false;
       }
     }
 
-    void WaitForClientConnection()
+    // index 为 acceptor 的下标，同时也是连接表分片的下标
+    void WaitForClientConnection(size_t index = 0)
     {
+      // 新连接的 socket 直接创建在它所属的 io_context 上，之后该连接的所有读写都在这个 io_context 的线程中执行
+      // 单个 acceptor 时轮询选择，多个 acceptor 时就是 acceptor 自己所在的 io_context
+      asio::io_context &clientCtx = m_acceptors.size() > 1 ? m_ctx_pool[index] : m_ctx_pool.GetNextContext();
+
       // 监听客户端连接
-      m_acceptor.async_accept([this](std::error_code ec, asio::ip::tcp::socket socket)
-                              {
+      m_acceptors[index]->async_accept(clientCtx, [this, index, &clientCtx](std::error_code ec, asio::ip::tcp::socket socket)
+                                       {
         bool isAccepted = !ec;
         if (isAccepted)
         {
-          std::cout << "[SERVER] New Connection: " << socket.remote_endpoint() << std::endl;
+          NET_LOG_INFO("[SERVER] New Connection: " << socket.remote_endpoint());
           // 这个 client 需要保留下来，后面服务器响应的时候要用到
-          std::shared_ptr<connection<T>> client = std::make_shared<connection<T>>(connection<T>::owner::server, ctx, std::move(socket), message_in_dq);
+          std::shared_ptr<connection<T>> client = std::make_shared<connection<T>>(connection<T>::owner::server, clientCtx, std::move(socket), message_in_dq);
+          // 在 OnClientConnect 之前设置，保证之后的 Send 都受水位限制
+          client->SetBackpressure(m_backpressure);
+          if (m_coalesce)
+            client->SetCoalescing(m_coalesce);
+          if (m_compression)
+            client->SetCompression(m_compression);
+          if (m_unreliable)
+            client->SetUnreliableChannel(&m_udp);
 
           // 由具体的业务服务，确定该请求是否接收
           isAccepted = OnClientConnect(client);
           if (isAccepted)
           {
-            // 注意一定要调用 std::move，不能 copy
-            m_connections_dq.emplace_back(std::move(client));
-            std::cout << "[-----] Connection Approved" << std::endl;
-
-            // 背后添加一个异步任务，io_context 是在一个子线程中允许全部的异步任务吗，执行顺序是和添加顺序一致吗？
-            // 在一个异步任务的结束时添加异步任务，添加的异步任务会立刻执行，还是在重新调度？
-            m_connections_dq.back()->ConnectToClient(this, nIDCounter++);
+            m_metrics.connectionsAccepted++;
+            // 先放入连接表再开始读写，保证读写失败时能从连接表中移除
+            connection_shard &shard = *m_shards[index];
+            uint32_t clientID = shard.nextID;
+            shard.nextID += uint32_t(m_shards.size());
+            {
+              std::lock_guard<std::mutex> lock(shard.mutex);
+              shard.connections.add(clientID, client);
+              // 设置 ID 并把握手 post 到连接自己的 io_context 上，在锁内设置 ID，遍历连接表的线程不会读到未设置的 ID
+              client->ConnectToClient(this, clientID);
+            }
+            NET_LOG_INFO("[-----] Connection Approved");
           }
         }
 
         if(!isAccepted)
         {
-          std::cout << "[-----] Connection Denied" << std::endl;
+          m_metrics.connectionsDenied++;
+          NET_LOG_INFO("[-----] Connection Denied");
         }
 
         // 循环监听
-        WaitForClientConnection(); });
+        WaitForClientConnection(index); });
     }
 
+    /**
+     * 停止 I/O 线程和路由表的工作线程
+     * 用 On(..., worker) 指定了工作线程时，派生类的析构函数中必须调用 Stop()（同 client_interface::StopWorker），
+     * 基类析构时派生类的成员已经析构，工作线程可能还在处理函数中访问它们
+     */
     void Stop()
     {
-      ctx.stop();
-      if (ctx_thread.joinable())
-        ctx_thread.join();
-      std::cout << "[SERVER] Stop!" << std::endl;
+      m_ctx_pool.Stop();
+      m_router.StopWorkers();
+      NET_LOG_INFO("[SERVER] Stop!");
+    }
+
+    /**
+     * 注册消息 id 的处理函数，Update() 中优先按路由表分发，没有注册的 id 才进入 OnMessage，见 message_router
+     * - handler(client, const message<T> &) 直接处理，handler(client, const Payload &) 先解码
+     * - worker 指定工作线程的编号时，该 id 的消息在这个线程中按顺序处理，Update() 的线程只负责转交
+     * 需要在 Start() 之前调用
+     */
+    template <typename Payload = void, typename F>
+    void On(T id, F &&handler, size_t worker = message_router<T>::InlineWorker)
+    {
+      m_router.template On<Payload>(id, std::forward<F>(handler), worker);
     }
 
     void SendMessageClient(std::shared_ptr<connection<T>> &client, const message<T> &msg)
     {
+      SendMessageClient(client, message<T>(msg));
+    }
+
+    void SendMessageClient(std::shared_ptr<connection<T>> &client, message<T> &&msg)
+    {
+      // 断开的连接在读写失败时已经从连接表中移除了，这里不需要再处理
       if (client->IsConnected())
+        client->Send(std::move(msg));
+    }
+
+    // 回复客户端的请求，把 request 的 correlation 拷贝到 response 中，co_client::Request 据此匹配响应
+    void Reply(std::shared_ptr<connection<T>> &client, const message<T> &request, message<T> &&response)
+    {
+      response.header.correlation = request.header.correlation;
+      SendMessageClient(client, std::move(response));
+    }
+
+    void Reply(std::shared_ptr<connection<T>> &client, const message<T> &request, const message<T> &response)
+    {
+      Reply(client, request, message<T>(response));
+    }
+
+    // 广播，消息只会拷贝一次到共享的只读 buffer 中，所有连接的发送队列共享这一份
+    void SendMessageAllClients(const message<T> &msg, const std::shared_ptr<connection<T>> &ignoreClient = nullptr)
+    {
+      SendMessageAllClients(std::make_shared<const message<T>>(msg), ignoreClient);
+    }
+
+    // 广播，消息直接移动到共享的只读 buffer 中，不拷贝
+    void SendMessageAllClients(message<T> &&msg, const std::shared_ptr<connection<T>> &ignoreClient = nullptr)
+    {
+      SendMessageAllClients(std::make_shared<const message<T>>(std::move(msg)), ignoreClient);
+    }
+
+    void SendMessageAllClients(shared_message<T> msg, const std::shared_ptr<connection<T>> &ignoreClient = nullptr)
+    {
+      auto sharedCompression = SharedCompressionFor(*msg);
+      ForEachClient([&](const std::shared_ptr<connection<T>> &client)
+                    {
+        if (client != ignoreClient && client->IsConnected())
+          client->Send(msg, sharedCompression); });
+    }
+
+    /**
+     * 把连接加入广播组，group 由业务定义（房间、频道、空间区域的 ID），组不存在时自动创建
+     * 已经断开或者已经在组中返回 false，连接断开时会自动退出所有组
+     */
+    bool Subscribe(uint32_t group, const std::shared_ptr<connection<T>> &client)
+    {
+      std::lock_guard<std::mutex> groupsLock(m_groups_mutex);
       {
-        client->Send(msg);
+        // 还在连接表中说明 OnConnectionClosed 还没有清理它的组，清理会在释放 m_groups_mutex 之后进行
+        connection_shard &shard = ShardOf(client->GetID());
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        if (shard.connections.find(client->GetID()) == nullptr)
+          return false;
       }
-      else
+      return m_groups.subscribe(group, client);
+    }
+
+    // 退出广播组，不在组中返回 false
+    bool Unsubscribe(uint32_t group, const std::shared_ptr<connection<T>> &client)
+    {
+      std::lock_guard<std::mutex> lock(m_groups_mutex);
+      return m_groups.unsubscribe(group, client->GetID());
+    }
+
+    // 退出所有广播组
+    void UnsubscribeAll(const std::shared_ptr<connection<T>> &client)
+    {
+      std::lock_guard<std::mutex> lock(m_groups_mutex);
+      m_groups.unsubscribe_all(client->GetID());
+    }
+
+    size_t GroupSize(uint32_t group)
+    {
+      std::lock_guard<std::mutex> lock(m_groups_mutex);
+      connection_registry<T> *members = m_groups.find(group);
+      return members == nullptr ? 0 : members->size();
+    }
+
+    void SendMessageGroup(uint32_t group, const message<T> &msg, const std::shared_ptr<connection<T>> &ignoreClient = nullptr)
+    {
+      SendMessageGroup(group, std::make_shared<const message<T>>(msg), ignoreClient);
+    }
+
+    void SendMessageGroup(uint32_t group, message<T> &&msg, const std::shared_ptr<connection<T>> &ignoreClient = nullptr)
+    {
+      SendMessageGroup(group, std::make_shared<const message<T>>(std::move(msg)), ignoreClient);
+    }
+
+    // 向组内所有成员广播，只遍历组内成员，所有成员共享同一份消息
+    void SendMessageGroup(uint32_t group, shared_message<T> msg, const std::shared_ptr<connection<T>> &ignoreClient = nullptr)
+    {
+      std::lock_guard<std::mutex> lock(m_groups_mutex);
+      connection_registry<T> *members = m_groups.find(group);
+      if (members == nullptr)
+        return;
+
+      auto sharedCompression = SharedCompressionFor(*msg);
+      for (auto &client : *members)
       {
-        // TODO: client 下线了，目前的设计要服务器要向客户端发送消息，才能知道客户端下线了，并释放连接资源
-        // 客户端下线，服务端无法立刻知道
-        OnClientDisConnect(client);
-        client.reset(); // 释放连接资源
-        // 进行指针比较的时候，都是通过内部管理的指针进行比较
-        // 先将元素移动到尾部，然后移除，效率更高
-        m_connections_dq.erase(std::remove(m_connections_dq.begin(), m_connections_dq.end(), nullptr), m_connections_dq.end());
+        if (client != ignoreClient && client->IsConnected())
+          client->Send(msg, sharedCompression);
       }
     }
 
-    void SendMessageAllClients(const message<T> msg, std::shared_ptr<connection<T>> &ignoreClient = nullptr)
+    /**
+     * 处理接收队列中的消息，返回本次处理的消息个数
+     * maxMessages: 最多处理多少条消息，size_t(-1) 表示不限制
+     * wait: 没有消息时是否阻塞等待
+     * timeBudget: 本次最多处理多长时间，为 0 表示不限制，游戏帧循环可以用它限制每帧的处理时间，没处理完的消息留到下次
+     * 消息会一次加锁批量取出，再逐个按路由表分发（见 On），没有注册的 id 调用 OnMessage
+     */
+    size_t Update(size_t maxMessages = 1, bool wait = true, std::chrono::steady_clock::duration timeBudget = std::chrono::steady_clock::duration::zero())
     {
-      bool removeInvalid = false;
-      for (auto &client : m_connections_dq)
+      if (m_batch_dq.empty() && wait)
+        message_in_dq.wait();
+
+      // 上次因为时间预算没处理完的消息还在 m_batch_dq 中，只补齐不足的部分
+      if (m_batch_dq.size() < maxMessages)
+        message_in_dq.pop_front_batch(m_batch_dq, maxMessages - m_batch_dq.size());
+
+      bool hasBudget = timeBudget > std::chrono::steady_clock::duration::zero();
+      auto deadline = std::chrono::steady_clock::now() + timeBudget;
+
+      size_t processed = 0;
+      while (processed < maxMessages && !m_batch_dq.empty())
       {
-        if (client->IsConnected())
-        {
-          if (client != ignoreClient)
-            client->Send(msg);
-        }
-        else
-        {
-          // client 下线了
-          OnClientDisConnect(client);
-          client.reset();
-          removeInvalid = true;
-        }
+        auto &msg = m_batch_dq.front();
+        m_metrics.inQueueTime.Record(uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - msg.received).count()));
+        m_metrics.messagesInByType.Increment(msg.msg.header.id);
+        // net_connection 的 AddTempMsgToQueue 里面通过共享智能指针引用加一保存了 remote client
+        if (!m_router.Dispatch(msg))
+          OnMessage(msg.remote, msg.msg);
+        m_batch_dq.pop_front();
+        processed++;
+
+        if (hasBudget && std::chrono::steady_clock::now() >= deadline)
+          break;
+      }
+
+      return processed;
+    }
+
+    /*--------------- 一些回调函数，不同的业务服务，可以有不同的回调函数 ----------------*/
+  public:
+    // 连接读写失败、验证失败或被关闭时，由 connection 在它的 I/O 线程中调用，立刻从连接表中移除并释放
+    void OnConnectionClosed(std::shared_ptr<connection<T>> client)
+    {
+      std::shared_ptr<connection<T>> removed;
+      {
+        connection_shard &shard = ShardOf(client->GetID());
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        removed = shard.connections.remove(client->GetID());
+      }
+
+      if (removed != nullptr)
+      {
+        std::lock_guard<std::mutex> lock(m_groups_mutex);
+        m_groups.unsubscribe_all(removed->GetID());
       }
 
-      if (removeInvalid)
-        m_connections_dq.erase(std::remove(m_connections_dq.begin(), m_connections_dq.end(), nullptr), m_connections_dq.end());
+      // 回调放在锁外面，业务代码可以在回调里调用 ClientCount() 等接口
+      if (removed != nullptr)
+      {
+        m_metrics.connectionsClosed++;
+        m_metrics.departed.Add(removed->GetMetrics());
+        OnClientDisConnect(removed);
+      }
     }
 
-    void Update()
+    /**
+     * 连接的发送队列超过高水位（congested 为 true）或者回到低水位以下（congested 为 false）
+     * 在该连接的 I/O 线程中调用，业务可以据此降低发给该客户端的频率
+     */
+    virtual void OnBackpressure(std::shared_ptr<connection<T>> client, bool congested)
     {
-      message_in_dq.wait();
-      auto msg = message_in_dq.pop_front();
-      // net_connection 的 AddTempMsgToQueue 里面通过共享智能指针引用加一保存了 remote client
-      OnMessage(msg.remote, msg.msg);
     }
 
-    /*--------------- 一些回调函数，不同的业务服务，可以有不同的回调函数 ----------------*/
-  public:
     // 客户端通过验证
     virtual void OnClientValidated(std::shared_ptr<connection<T>> client)
     {
     }
 
+    /**
+     * 收到一条 TCP 消息时在该连接的 I/O 线程中调用，返回 true 表示已经处理完，消息不再进入接收队列（路由表和 OnMessage）
+     * 适合不访问共享状态、可以直接回复的消息（心跳、回显等），这样处理会随 I/O 线程数扩展，不受单个 Update() 线程的限制
+     * 多个 I/O 线程会同时调用，业务代码要自己保证线程安全；默认返回 false，所有消息都交给 Update()
+     */
+    virtual bool OnIOMessage(const std::shared_ptr<connection<T>> &client, const message<T> &msg)
+    {
+      return false;
+    }
+
   protected:
-    // 决定是否建立连接
+    /**
+     * 连接表的一个分片，每个 acceptor 一个
+     * nextID 只在该 acceptor 的线程中访问，connections 会被 accept 线程、各个 I/O 线程（断开）和业务线程（广播）访问
+     */
+    struct connection_shard
+    {
+      connection_registry<T> connections;
+      std::mutex mutex;
+      uint32_t nextID = 0;
+    };
+
+    connection_shard &ShardOf(uint32_t id)
+    {
+      return *m_shards[(id - 10000) % m_shards.size()];
+    }
+
+    // 依次锁住每个分片，对其中的每个连接调用 f
+    template <typename F>
+    void ForEachClient(F &&f)
+    {
+      for (auto &shard : m_shards)
+      {
+        std::lock_guard<std::mutex> lock(shard->mutex);
+        for (auto &client : shard->connections)
+          f(client);
+      }
+    }
+
+    // 广播消息需要压缩时，所有连接共用一份压缩结果；不需要压缩时返回空，不额外分配
+    std::shared_ptr<shared_compression<T>> SharedCompressionFor(const message<T> &msg) const
+    {
+      if (!m_compression || !m_compression->Match(msg.header.id, msg.body.size()))
+        return nullptr;
+      return std::make_shared<shared_compression<T>>();
+    }
+
+    // 决定是否建立连接，多个 acceptor 时会在不同的 I/O 线程中同时调用
     virtual bool OnClientConnect(std::shared_ptr<connection<T>> client)
     {
       return true;
     }
 
-    // 是否连接
+    // 连接断开，在该连接的 I/O 线程中调用，此时已经从连接表中移除
     virtual void OnClientDisConnect(std::shared_ptr<connection<T>> client)
     {
     }
 
+    // udp 通道收到数据报，按连接 ID 找到连接并校验 token，在 m_ctx_pool[0] 的线程中调用
+    void OnDatagram(const udp_header &header, message<T> &&msg, const asio::ip::udp::endpoint &from)
+    {
+      std::shared_ptr<connection<T>> client = GetClient(header.id);
+      if (client)
+        client->ReceiveUnreliable(header.token, from, std::move(msg));
+    }
+
     // 接收到客户端消息包
     virtual void OnMessage(std::shared_ptr<connection<T>> client, const message<T> &msg)
     {
     }
 
-    asio::io_context ctx;
-    std::thread ctx_thread;
-    asio::ip::tcp::acceptor m_acceptor;
-    // Container of active validated connections
-    std::deque<std::shared_ptr<connection<T>>> m_connections_dq;
+    // I/O 线程池，单个 acceptor 时 m_ctx_pool[0] 同时负责 accept
+    io_context_pool m_ctx_pool;
+    std::vector<std::unique_ptr<asio::ip::tcp::acceptor>> m_acceptors;
+    // 不可靠通道，所有连接共享，只在 m_ctx_pool[0] 的线程中收发
+    udp_channel<T> m_udp;
+    std::uint16_t m_port;
+    bool m_unreliable = false;
+    // Container of active connections, indexed by connection ID
+    std::vector<std::unique_ptr<connection_shard>> m_shards;
+    // 广播组，同时需要两个锁时先锁 m_groups_mutex
+    group_registry<T> m_groups;
+    std::mutex m_groups_mutex;
 
-    tsqueue<owned_message<T>> message_in_dq;
+    inbound_queue<owned_message<T>> message_in_dq;
+    server_metrics<T> m_metrics;
+    backpressure_config m_backpressure;
+    std::shared_ptr<const coalesce_rules<T>> m_coalesce;
+    std::shared_ptr<const compression_rules<T>> m_compression;
 
-    // Clients will be identified in the "wider system" via an ID
-    uint32_t nIDCounter = 10000;
+    // Update() 一次批量取出的消息，只在调用 Update() 的线程中访问
+    pooled_deque<owned_message<T>> m_batch_dq;
+    // 按消息 id 分发的路由表，最后声明，析构时最先等待工作线程退出
+    message_router<T> m_router;
   };
 }
@@ -1,9 +1,12 @@
 #pragma once
 
+#include "net_buffer_pool.hpp"
 #include <mutex>
 #include <deque>
+#include <chrono>
 #include <stddef.h>
 #include <condition_variable>
+#include <algorithm>
 
 namespace net
 {
@@ -15,7 +18,8 @@ namespace net
   {
   protected:
     std::mutex _mutex;
-    std::deque<T> dq;
+    // 节点从 buffer_pool 分配，收消息的热路径上不会调用 new
+    pooled_deque<T> dq;
 
     // 取的条件变量
     std::condition_variable cond;
@@ -26,7 +30,7 @@ namespace net
     ~tsqueue()
     {
       dq.clear();
-      std::deque<T>().swap(dq);
+      decltype(dq)().swap(dq);
     };
 
     const T &front()
@@ -42,6 +46,13 @@ namespace net
     }
 
     void emplace_back(const T &item)
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      dq.emplace_back(item);
+      cond.notify_all();
+    }
+
+    void emplace_back(T &&item)
     {
       std::lock_guard<std::mutex> lock(_mutex);
       dq.emplace_back(std::move(item));
@@ -49,6 +60,13 @@ namespace net
     }
 
     void emplace_front(const T &item)
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      dq.emplace_front(item);
+      cond.notify_all();
+    }
+
+    void emplace_front(T &&item)
     {
       std::lock_guard<std::mutex> lock(_mutex);
       dq.emplace_front(std::move(item));
@@ -70,6 +88,15 @@ namespace net
       }
     }
 
+    // 最多等待 timeout，返回队列是否非空
+    template <typename Rep, typename Period>
+    bool wait_for(const std::chrono::duration<Rep, Period> &timeout)
+    {
+      std::unique_lock<std::mutex> lock(_mutex);
+      return cond.wait_for(lock, timeout, [this]()
+                           { return !dq.empty(); });
+    }
+
     size_t count()
     {
       std::lock_guard<std::mutex> lock(_mutex);
@@ -90,6 +117,27 @@ namespace net
       return t;
     }
 
+    // 一次加锁取出最多 maxCount 个元素，追加到 out 的尾部，返回取出的个数
+    size_t pop_front_batch(pooled_deque<T> &out, size_t maxCount)
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      if (out.empty() && maxCount >= dq.size())
+      {
+        // 全部取出时直接交换，不需要逐个移动
+        size_t n = dq.size();
+        dq.swap(out);
+        return n;
+      }
+
+      size_t n = std::min(maxCount, dq.size());
+      for (size_t i = 0; i < n; i++)
+      {
+        out.emplace_back(std::move(dq.front()));
+        dq.pop_front();
+      }
+      return n;
+    }
+
     T pop_back()
     {
       std::lock_guard<std::mutex> lock(_mutex);
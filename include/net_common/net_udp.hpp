@@ -0,0 +1,127 @@
+#pragma once
+
+#include "asio.hpp"
+#include "net_message.hpp"
+#include "net_log.hpp"
+#include <array>
+#include <functional>
+#include <vector>
+#include <stddef.h>
+#include <stdint.h>
+
+namespace net
+{
+  /**
+   * 不可靠通道（UDP）数据报的头部，后面紧跟 message_header 和消息体
+   * id 是 TCP 连接的 ID（服务端在握手时发给客户端），token 是握手时的验证结果，只有双方知道
+   */
+  struct udp_header
+  {
+    uint32_t id = 0;
+    uint32_t reserved = 0;
+    uint64_t token = 0;
+  };
+
+  /**
+   * 一个 UDP socket，收发带 udp_header 的数据报
+   * - 服务端所有连接共享一个，客户端每个连接一个
+   * - 所有操作都必须在 ctx 线程中执行，SendTo 使用非阻塞的同步发送，发送缓冲区满时直接丢弃（本来就是不可靠的）
+   */
+  template <typename T>
+  class udp_channel
+  {
+  public:
+    // 单个数据报最大 bytes（IPv4 UDP 的上限），超过 MTU 的数据报会被 IP 分片，丢包率更高，建议控制在 1200 bytes 以内
+    static constexpr size_t MaxDatagramBytes = 65507;
+
+    using receive_handler = std::function<void(const udp_header &, message<T> &&, const asio::ip::udp::endpoint &)>;
+
+    udp_channel(asio::io_context &ctx) : ctx(ctx), socket(ctx) {}
+
+    asio::io_context &Context()
+    {
+      return ctx;
+    }
+
+    bool IsOpen() const
+    {
+      return socket.is_open();
+    }
+
+    // 绑定本地地址并开始接收，端口为 0 时由系统分配
+    void Open(const asio::ip::udp::endpoint &local, receive_handler handler)
+    {
+      onReceive = std::move(handler);
+      socket.open(local.protocol());
+      socket.bind(local);
+      socket.non_blocking(true);
+      receiveBuffer.resize(MaxDatagramBytes);
+      Receive();
+    }
+
+    void Close()
+    {
+      asio::error_code ec;
+      socket.close(ec);
+    }
+
+    // 发送一条消息，超过 MaxDatagramBytes 或者发送失败时返回 false
+    bool SendTo(const asio::ip::udp::endpoint &remote, uint32_t id, uint64_t token, const message<T> &msg)
+    {
+      if (sizeof(udp_header) + sizeof(message_header<T>) + msg.body.size() > MaxDatagramBytes)
+      {
+        NET_LOG_WARN("[" << id << "] Datagram Too Large: " << msg.body.size() << " bytes");
+        return false;
+      }
+
+      udp_header header;
+      header.id = id;
+      header.token = token;
+      std::array<asio::const_buffer, 3> buffers{asio::buffer(&header, sizeof(udp_header)), asio::buffer(&msg.header, sizeof(message_header<T>)), asio::buffer(msg.body.data(), msg.body.size())};
+
+      asio::error_code ec;
+      socket.send_to(buffers, remote, 0, ec);
+      return !ec;
+    }
+
+  protected:
+    asio::io_context &ctx;
+    asio::ip::udp::socket socket;
+    std::vector<uint8_t> receiveBuffer;
+    asio::ip::udp::endpoint remoteEndpoint;
+    receive_handler onReceive;
+
+    void Receive()
+    {
+      socket.async_receive_from(asio::buffer(receiveBuffer), remoteEndpoint, [this](asio::error_code ec, std::size_t length)
+                                {
+        if (ec == asio::error::operation_aborted || !socket.is_open())
+          return;
+
+        // 其他错误（例如对端端口不可达）只影响这一个数据报，继续接收
+        if (!ec)
+          Dispatch(length);
+        Receive(); });
+    }
+
+    // 校验数据报的长度，格式不对的直接丢弃
+    void Dispatch(size_t length)
+    {
+      if (length < sizeof(udp_header) + sizeof(message_header<T>))
+        return;
+
+      udp_header header;
+      message<T> msg;
+      std::memcpy(&header, receiveBuffer.data(), sizeof(udp_header));
+      std::memcpy(&msg.header, receiveBuffer.data() + sizeof(udp_header), sizeof(message_header<T>));
+
+      const uint8_t *body = receiveBuffer.data() + sizeof(udp_header) + sizeof(message_header<T>);
+      size_t bodyBytes = length - sizeof(udp_header) - sizeof(message_header<T>);
+      if (msg.header.size != bodyBytes)
+        return;
+
+      assign_bytes(msg.body, body, bodyBytes);
+      onReceive(header, std::move(msg), remoteEndpoint);
+    }
+  };
+}
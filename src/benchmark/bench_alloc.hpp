@@ -0,0 +1,44 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+#include <stdint.h>
+
+/**
+ * 替换全局的 operator new/delete（包括数组和对齐的版本）统计整个进程的分配次数，new 和 delete 也能配对
+ * 替换的函数在一个程序中只能定义一次，只能由 benchmark 的 .cpp include，bench_common.hpp 不包含它
+ */
+
+static std::atomic<uint64_t> g_allocs(0);
+
+static void *CountedAlloc(size_t bytes, size_t alignment)
+{
+  g_allocs.fetch_add(1, std::memory_order_relaxed);
+  if (bytes == 0)
+    bytes = 1;
+  void *p = nullptr;
+  if (alignment <= alignof(std::max_align_t))
+    p = std::malloc(bytes);
+  else
+    // aligned_alloc 要求大小是对齐的整数倍
+    p = std::aligned_alloc(alignment, (bytes + alignment - 1) / alignment * alignment);
+  if (p == nullptr)
+    throw std::bad_alloc();
+  return p;
+}
+
+void *operator new(size_t bytes) { return CountedAlloc(bytes, 0); }
+void *operator new[](size_t bytes) { return CountedAlloc(bytes, 0); }
+void *operator new(size_t bytes, std::align_val_t al) { return CountedAlloc(bytes, size_t(al)); }
+void *operator new[](size_t bytes, std::align_val_t al) { return CountedAlloc(bytes, size_t(al)); }
+
+void operator delete(void *p) noexcept { std::free(p); }
+void operator delete[](void *p) noexcept { std::free(p); }
+void operator delete(void *p, size_t) noexcept { std::free(p); }
+void operator delete[](void *p, size_t) noexcept { std::free(p); }
+void operator delete(void *p, std::align_val_t) noexcept { std::free(p); }
+void operator delete[](void *p, std::align_val_t) noexcept { std::free(p); }
+void operator delete(void *p, size_t, std::align_val_t) noexcept { std::free(p); }
+void operator delete[](void *p, size_t, std::align_val_t) noexcept { std::free(p); }
@@ -0,0 +1,133 @@
+#pragma once
+
+#ifdef _WIN32
+#define _WIN32_WINNT 0x0A00
+#endif
+#include "net_common/net_server.hpp"
+#include "net_common/net_client.hpp"
+#include "net_common/net_context_pool.hpp"
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * 各个 benchmark 共用的服务端、客户端和建立连接的步骤，benchmark 中只保留自己测量的部分
+ * 服务端和客户端在同一个进程中，走 loopback
+ */
+
+using bench_clock = std::chrono::steady_clock;
+
+// 回显类 benchmark 的消息类型
+enum class EchoMsgType : uint32_t
+{
+  ServerValidated,
+  Echo,
+};
+
+/**
+ * benchmark 的服务端：验证通过时发送 T::ServerValidated，客户端收到之后才能开始发送，否则会和验证码的读写交错
+ * StartPump() 在后台线程中循环调用不阻塞的 Update()，阻塞的 Update() 在队列为空时会一直等待，压测结束时需要能退出
+ * 派生类的 OnMessage 用到自己的成员时，应该在派生类的析构函数中先调用 StopPump()
+ */
+template <typename T>
+class BenchServer : public net::server_interface<T>
+{
+public:
+  BenchServer(uint16_t port, size_t nThreads = 1, bool sharded = false) : net::server_interface<T>(port, nThreads, sharded) {}
+
+  virtual ~BenchServer()
+  {
+    StopPump();
+    this->Stop();
+  }
+
+  void StartPump()
+  {
+    pumping = true;
+    pumpThread = std::thread([this]()
+                             {
+      while (pumping)
+      {
+        if (this->Update(size_t(-1), false) == 0)
+          std::this_thread::yield();
+      } });
+  }
+
+  void StopPump()
+  {
+    pumping = false;
+    if (pumpThread.joinable())
+      pumpThread.join();
+  }
+
+protected:
+  std::atomic<bool> pumping{false};
+  std::thread pumpThread;
+
+  virtual void OnClientValidated(std::shared_ptr<net::connection<T>> client)
+  {
+    net::message<T> msg;
+    msg.header.id = T::ServerValidated;
+    client->Send(std::move(msg));
+  }
+};
+
+// 把收到的消息原样发回去
+template <typename T>
+class EchoServer : public BenchServer<T>
+{
+public:
+  using BenchServer<T>::BenchServer;
+
+protected:
+  virtual void OnMessage(std::shared_ptr<net::connection<T>> client, const net::message<T> &msg)
+  {
+    client->Send(msg);
+  }
+};
+
+/**
+ * 创建 n 个 Client（client_interface 的子类，每个客户端一个 I/O 线程）连接本机的 port，并等待全部验证通过
+ * 返回时每个客户端的 ServerValidated 消息已经从 InComing() 中取走
+ */
+template <typename Client>
+std::vector<std::unique_ptr<Client>> ConnectClients(uint16_t port, size_t n)
+{
+  std::vector<std::unique_ptr<Client>> clients;
+  for (size_t i = 0; i < n; i++)
+  {
+    clients.emplace_back(std::make_unique<Client>());
+    clients.back()->Connect("127.0.0.1", port);
+  }
+
+  for (auto &c : clients)
+  {
+    c->InComing().wait();
+    c->InComing().pop_front();
+  }
+  return clients;
+}
+
+/**
+ * 在共享的 io_context 池上创建 n 个客户端连接，而不是每个 client_interface 一个线程，这样才能开到几千个连接
+ * 所有连接收到的消息都进入 inQueue（remote 为 nullptr），不等待验证，调用方从 inQueue 中统计 ServerValidated
+ */
+template <typename T>
+std::vector<std::shared_ptr<net::connection<T>>> ConnectPooledClients(net::io_context_pool &pool, net::inbound_queue<net::owned_message<T>> &inQueue, uint16_t port, size_t n)
+{
+  asio::ip::tcp::resolver resolver(pool[0]);
+  auto endpoints = resolver.resolve("127.0.0.1", std::to_string(port));
+
+  std::vector<std::shared_ptr<net::connection<T>>> clients;
+  clients.reserve(n);
+  for (size_t i = 0; i < n; i++)
+  {
+    asio::io_context &ctx = pool.GetNextContext();
+    clients.emplace_back(std::make_shared<net::connection<T>>(net::connection<T>::owner::client, ctx, asio::ip::tcp::socket(ctx), inQueue));
+    clients.back()->ConnectToServer(endpoints);
+  }
+  return clients;
+}
@@ -0,0 +1,149 @@
+#include "bench_common.hpp"
+#include "bench_alloc.hpp"
+#include <iostream>
+#include <chrono>
+#include <vector>
+#include <string>
+
+/**
+ * 统计读写路径上向系统申请内存的次数
+ * 先预热一轮，之后的若干轮回显中 buffer_pool 的 mallocs 逐渐降到 +0（内存块在各个线程的缓存之间分布变化时偶尔会再申请几块）
+ * 同时替换全局 operator new（bench_alloc.hpp）统计整个进程的分配次数：message 的 body、收发队列的 deque 节点和发送批的数组都来自 buffer_pool，
+ * 所以 operator new 应该等于 pool mallocs + large allocs，没有其它分配
+ * 开始前先测一下 body 拷贝（message 拷贝构造、拷贝赋值、解析报文时的 assign_bytes）的耗时，和 std::vector<uint8_t> 的拷贝对比
+ * 用法：buffer-pool-benchmark [客户端数] [每轮每个客户端消息数] [轮数]
+ */
+
+using BenchMsgType = EchoMsgType;
+
+// 每个客户端最多同时有几条消息在路上：Send 的 post 只有 8 块 handler_memory，一次发出几千条时多出来的 post 会退回 operator new，
+// 那部分是 handler 的分配（见 handler-memory-benchmark），这里只关心 body 和队列的内存
+static constexpr size_t Window = 4;
+
+// 一轮回显，消息体大小在 16B ~ 16KiB 之间变化，覆盖多个内存级别
+void RunRound(net::client_interface<BenchMsgType> *pClient, size_t nMessages)
+{
+  size_t sent = 0;
+  for (size_t received = 0; received < nMessages; received++)
+  {
+    for (; sent < nMessages && sent - received < Window; sent++)
+    {
+      net::message<BenchMsgType> msg;
+      msg.header.id = BenchMsgType::Echo;
+      msg.body.resize(size_t(16) << (sent % 11));
+      msg.header.size = msg.size();
+      pClient->Send(msg);
+    }
+
+    pClient->InComing().wait();
+    pClient->InComing().pop_front();
+  }
+}
+
+template <typename F>
+double MeasureCopy(size_t nIterations, uint64_t &checksum, F &&copy)
+{
+  auto start = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < nIterations; i++)
+    checksum += copy();
+  return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / double(nIterations);
+}
+
+// body 拷贝的耗时：使用 pool_allocator 时不能走 vector 的拷贝构造和 assign（逐个 byte 构造），应该和 std::vector<uint8_t> 相当
+void RunCopyBenchmark(size_t nIterations)
+{
+  uint64_t checksum = 0;
+  std::cout << "body bytes\tstd::vector copy\tmessage copy\tmessage assign\tassign_bytes (ns)" << std::endl;
+  for (size_t bytes : {64, 1024, 4096, 16384})
+  {
+    std::vector<uint8_t> raw(bytes, 1);
+    net::message<BenchMsgType> src;
+    src.body.resize(bytes, 1);
+    src.header.size = src.size();
+    net::message<BenchMsgType> dst;
+
+    double vectorNs = MeasureCopy(nIterations, checksum, [&]()
+                                  { std::vector<uint8_t> copy(raw); return copy[bytes - 1]; });
+    double copyNs = MeasureCopy(nIterations, checksum, [&]()
+                                { net::message<BenchMsgType> copy(src); return copy.body[bytes - 1]; });
+    double assignNs = MeasureCopy(nIterations, checksum, [&]()
+                                  { dst = src; return dst.body[bytes - 1]; });
+    double bytesNs = MeasureCopy(nIterations, checksum, [&]()
+                                 { dst.body.clear(); net::assign_bytes(dst.body, raw.data(), raw.size()); return dst.body[bytes - 1]; });
+    std::cout << bytes << "\t\t" << vectorNs << "\t\t\t" << copyNs << "\t\t" << assignNs << "\t\t" << bytesNs << std::endl;
+  }
+  // 输出 checksum，避免拷贝被优化掉
+  std::cout << "(checksum " << checksum << ")" << std::endl
+            << std::endl;
+}
+
+int main(int argc, char **argv)
+{
+  size_t nClients = 8;
+  size_t nMessages = 5000;
+  size_t nRounds = 5;
+
+  if (argc > 1)
+    nClients = std::stoul(argv[1]);
+  if (argc > 2)
+    nMessages = std::stoul(argv[2]);
+  if (argc > 3)
+    nRounds = std::stoul(argv[3]);
+
+  RunCopyBenchmark(100000);
+
+  uint16_t port = 60100;
+  EchoServer<BenchMsgType> server(port);
+  server.Start();
+  server.StartPump();
+
+  auto clients = ConnectClients<net::client_interface<BenchMsgType>>(port, nClients);
+
+  // 每个客户端一个发送线程，所有轮次共用：每轮新建的线程的缓存是空的，会从全局链表抢内存块，创建线程本身也要 new
+  // 第 0 轮是预热，让各个线程的缓存和全局链表填满
+  std::atomic<size_t> round(0);
+  std::atomic<size_t> done(0);
+  std::vector<std::thread> workers;
+  for (auto &c : clients)
+  {
+    net::client_interface<BenchMsgType> *pClient = c.get();
+    workers.emplace_back([pClient, nMessages, nRounds, &round, &done]()
+                         {
+      for (size_t r = 1; r <= nRounds + 1; r++)
+      {
+        while (round < r)
+          std::this_thread::yield();
+        RunRound(pClient, nMessages);
+        done++;
+      } });
+  }
+
+  std::cout << "round\tmessages\tpool mallocs\tlarge allocs\thandler fallbacks\toperator new" << std::endl;
+  for (size_t r = 0; r <= nRounds; r++)
+  {
+    auto last = net::buffer_pool::Stats();
+    uint64_t fallbacks = net::handler_memory_fallbacks().load();
+    uint64_t allocs = g_allocs.load();
+    done = 0;
+    round++;
+    while (done < workers.size())
+      std::this_thread::yield();
+    auto now = net::buffer_pool::Stats();
+    fallbacks = net::handler_memory_fallbacks().load() - fallbacks;
+    allocs = g_allocs.load() - allocs;
+
+    if (r == 0)
+      std::cout << "warmup\t" << nClients * nMessages << "\t\t" << now.mallocs << "\t\t" << now.largeAllocs << "\t\t" << fallbacks << "\t\t\t" << allocs << std::endl;
+    else
+      std::cout << r << "\t" << nClients * nMessages << "\t\t+" << now.mallocs - last.mallocs << "\t\t+" << now.largeAllocs - last.largeAllocs << "\t\t+" << fallbacks << "\t\t\t+" << allocs << std::endl;
+  }
+
+  for (auto &t : workers)
+    t.join();
+
+  clients.clear();
+  server.StopPump();
+  server.Stop();
+
+  return 0;
+}
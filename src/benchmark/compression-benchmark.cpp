@@ -0,0 +1,204 @@
+#include "bench_common.hpp"
+#include "net_common/net_compress.hpp"
+#include <iostream>
+#include <chrono>
+#include <vector>
+#include <string>
+#include <random>
+
+/**
+ * 压缩的 CPU 开销和节省的带宽
+ * 1. 单独测试 lz4_block 对几种典型数据的压缩率和压缩/解压速度
+ * 2. 服务端向一个客户端发送大量快照消息（走 loopback），对比开启和关闭压缩时的耗时和实际写入 socket 的 bytes
+ *    loopback 带宽几乎无限，压缩只会更慢；按给定的链路带宽估算传输时间，才能看出压缩在真实网络上的收益
+ * 用法：compression-benchmark [快照消息 bytes] [消息数] [链路带宽 Mbit/s]
+ */
+
+enum class BenchMsgType : uint32_t
+{
+  ServerValidated,
+  Start,
+  Snapshot,
+};
+
+// 地图块：大片相同的地形，偶尔有不同的格子
+std::vector<uint8_t> MakeMapChunk(size_t bytes, std::mt19937 &rng)
+{
+  std::vector<uint8_t> data(bytes);
+  uint8_t tile = 1;
+  for (size_t i = 0; i < bytes; i++)
+  {
+    if (rng() % 64 == 0)
+      tile = uint8_t(rng() % 8);
+    data[i] = rng() % 16 == 0 ? uint8_t(rng()) : tile;
+  }
+  return data;
+}
+
+// 实体快照：结构体数组，ID 递增，坐标在小范围内变化，其余字段大多相同
+std::vector<uint8_t> MakeSnapshot(size_t bytes, std::mt19937 &rng)
+{
+  struct Entity
+  {
+    uint32_t id;
+    float x, y, z;
+    uint16_t hp, maxHp;
+    uint32_t flags;
+  };
+
+  std::vector<uint8_t> data(bytes);
+  for (size_t i = 0; i + sizeof(Entity) <= bytes; i += sizeof(Entity))
+  {
+    Entity e{uint32_t(i / sizeof(Entity)), float(rng() % 100), 0.0f, float(rng() % 100), 100, 100, 0};
+    std::memcpy(data.data() + i, &e, sizeof(Entity));
+  }
+  return data;
+}
+
+std::vector<uint8_t> MakeRandom(size_t bytes, std::mt19937 &rng)
+{
+  std::vector<uint8_t> data(bytes);
+  for (auto &b : data)
+    b = uint8_t(rng());
+  return data;
+}
+
+void BenchCodec(const char *name, const std::vector<uint8_t> &data)
+{
+  std::vector<uint8_t> compressed(net::lz4_block::Bound(data.size()));
+  std::vector<uint8_t> restored(data.size());
+
+  // 至少处理 64 MiB，让计时足够稳定
+  size_t rounds = std::max<size_t>(1, (64 << 20) / data.size());
+  size_t compressedBytes = 0;
+
+  auto start = bench_clock::now();
+  for (size_t i = 0; i < rounds; i++)
+    compressedBytes = net::lz4_block::Compress(data.data(), data.size(), compressed.data(), compressed.size());
+  double compressSeconds = std::chrono::duration<double>(bench_clock::now() - start).count();
+
+  bool ok = true;
+  start = bench_clock::now();
+  for (size_t i = 0; i < rounds; i++)
+    ok = net::lz4_block::Decompress(compressed.data(), compressedBytes, restored.data(), restored.size()) && ok;
+  double decompressSeconds = std::chrono::duration<double>(bench_clock::now() - start).count();
+  ok = ok && restored == data;
+
+  double mib = double(data.size()) * double(rounds) / (1024 * 1024);
+  std::cout << name << " " << data.size() << " bytes: ratio " << double(data.size()) / double(compressedBytes)
+            << ", compress " << mib / compressSeconds << " MiB/s, decompress " << mib / decompressSeconds << " MiB/s"
+            << (ok ? "" : " (ROUND TRIP FAILED)") << std::endl;
+}
+
+class SnapshotServer : public BenchServer<BenchMsgType>
+{
+public:
+  SnapshotServer(uint16_t port, const std::vector<uint8_t> &snapshot, size_t nMessages) : BenchServer<BenchMsgType>(port), snapshot(snapshot), nMessages(nMessages) {}
+
+  virtual ~SnapshotServer()
+  {
+    StopPump();
+  }
+
+protected:
+  const std::vector<uint8_t> &snapshot;
+  size_t nMessages;
+
+  virtual void OnMessage(std::shared_ptr<net::connection<BenchMsgType>> client, const net::message<BenchMsgType> &msg)
+  {
+    if (msg.header.id != BenchMsgType::Start)
+      return;
+
+    for (size_t i = 0; i < nMessages; i++)
+    {
+      net::message<BenchMsgType> snapshotMsg;
+      snapshotMsg.header.id = BenchMsgType::Snapshot;
+      net::assign_bytes(snapshotMsg.body, snapshot.data(), snapshot.size());
+      snapshotMsg.header.size = snapshotMsg.size();
+      client->Send(std::move(snapshotMsg));
+    }
+  }
+};
+
+// 返回从请求到收完所有快照的秒数，wireBytes 为服务端实际写入 socket 的 bytes
+double RunTransfer(uint16_t port, bool compress, const std::vector<uint8_t> &snapshot, size_t nMessages, uint64_t &wireBytes)
+{
+  SnapshotServer server(port, snapshot, nMessages);
+  if (compress)
+    server.SetCompressible(BenchMsgType::Snapshot);
+  server.Start();
+  server.StartPump();
+
+  auto clients = ConnectClients<net::client_interface<BenchMsgType>>(port, 1);
+  net::client_interface<BenchMsgType> &client = *clients.front();
+
+  auto start = bench_clock::now();
+  net::message<BenchMsgType> request;
+  request.header.id = BenchMsgType::Start;
+  client.Send(std::move(request));
+
+  size_t received = 0;
+  auto deadline = bench_clock::now() + std::chrono::seconds(60);
+  while (received < nMessages && bench_clock::now() < deadline)
+  {
+    if (client.InComing().empty())
+    {
+      std::this_thread::yield();
+      continue;
+    }
+
+    auto msg = client.InComing().pop_front().msg;
+    if (msg.body.size() != snapshot.size() || std::memcmp(msg.body.data(), snapshot.data(), snapshot.size()) != 0)
+      std::cout << "snapshot mismatch" << std::endl;
+    received++;
+  }
+  double seconds = std::chrono::duration<double>(bench_clock::now() - start).count();
+  if (received < nMessages)
+    std::cout << "timeout, received " << received << "/" << nMessages << std::endl;
+
+  wireBytes = server.GetMetrics().totals.bytesOut;
+
+  clients.clear();
+  server.StopPump();
+  server.Stop();
+  return seconds;
+}
+
+int main(int argc, char **argv)
+{
+  size_t snapshotBytes = 64 * 1024;
+  size_t nMessages = 2000;
+  double linkMbps = 100;
+
+  if (argc > 1)
+    snapshotBytes = std::stoul(argv[1]);
+  if (argc > 2)
+    nMessages = std::stoul(argv[2]);
+  if (argc > 3)
+    linkMbps = std::stod(argv[3]);
+
+  std::mt19937 rng(42);
+  for (size_t bytes : {size_t(1024), size_t(16 * 1024), size_t(256 * 1024)})
+  {
+    BenchCodec("map chunk", MakeMapChunk(bytes, rng));
+    BenchCodec("snapshot ", MakeSnapshot(bytes, rng));
+    BenchCodec("random   ", MakeRandom(bytes, rng));
+  }
+
+  std::cout << std::endl
+            << "transfer: " << nMessages << " snapshots of " << snapshotBytes << " bytes, link " << linkMbps << " Mbit/s" << std::endl;
+
+  std::vector<uint8_t> snapshot = MakeSnapshot(snapshotBytes, rng);
+  uint16_t port = 60300;
+  for (bool compress : {false, true})
+  {
+    uint64_t wireBytes = 0;
+    double seconds = RunTransfer(port++, compress, snapshot, nMessages, wireBytes);
+    // 链路上的传输时间，加上本机测得的耗时（包含压缩和解压的 CPU 时间）作为粗略估计
+    double linkSeconds = double(wireBytes) * 8 / (linkMbps * 1e6);
+    std::cout << (compress ? "compressed  " : "uncompressed") << ": " << seconds << " s on loopback, "
+              << wireBytes << " bytes on wire, est. " << seconds + linkSeconds << " s over link" << std::endl;
+  }
+
+  return 0;
+}
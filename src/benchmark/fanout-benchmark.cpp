@@ -0,0 +1,114 @@
+#ifdef _WIN32
+#define _WIN32_WINNT 0x0A00
+#endif
+#include "asio.hpp"
+#include "net_common/net_message.hpp"
+#include "net_common/net_tsqueue.hpp"
+#include <iostream>
+#include <chrono>
+#include <vector>
+#include <memory>
+#include <string>
+
+/**
+ * 广播的拷贝开销：每个连接拷贝一份消息 vs 所有连接共享一份只读消息
+ * 和 connection::Send 一样，每个连接 post 一个任务到 io_context，任务中把消息放入该连接的发送队列
+ * 不经过 socket，只统计广播本身的耗时和拷贝的 bytes
+ * 用法：fanout-benchmark [消息体 bytes] [广播次数]
+ */
+
+enum class BenchMsgType : uint32_t
+{
+  WorldState,
+};
+
+using out_queue = net::tsqueue<net::outgoing_message<BenchMsgType>>;
+
+struct result
+{
+  double usPerBroadcast;
+  double bytesCopiedPerBroadcast;
+};
+
+result RunCopy(std::vector<std::unique_ptr<out_queue>> &queues, const net::message<BenchMsgType> &msg, size_t nBroadcasts)
+{
+  asio::io_context ctx;
+  auto start = std::chrono::steady_clock::now();
+  for (size_t b = 0; b < nBroadcasts; b++)
+  {
+    for (auto &q : queues)
+    {
+      out_queue *pQueue = q.get();
+      // 原来的做法：拷贝到 lambda 中，再拷贝到发送队列
+      asio::post(ctx, [pQueue, msg]()
+                 { pQueue->emplace_back(net::outgoing_message<BenchMsgType>(msg)); });
+    }
+    ctx.run();
+    ctx.restart();
+  }
+  auto elapsed = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+
+  for (auto &q : queues)
+    q->clear();
+
+  return {elapsed / nBroadcasts, double(queues.size()) * msg.size() * 2};
+}
+
+result RunShared(std::vector<std::unique_ptr<out_queue>> &queues, const net::message<BenchMsgType> &msg, size_t nBroadcasts)
+{
+  asio::io_context ctx;
+  auto start = std::chrono::steady_clock::now();
+  for (size_t b = 0; b < nBroadcasts; b++)
+  {
+    // SendMessageAllClients 的做法：只拷贝一次，之后只增加引用计数
+    net::shared_message<BenchMsgType> shared = std::make_shared<const net::message<BenchMsgType>>(msg);
+    for (auto &q : queues)
+    {
+      out_queue *pQueue = q.get();
+      asio::post(ctx, [pQueue, shared]()
+                 { pQueue->emplace_back(net::outgoing_message<BenchMsgType>(shared)); });
+    }
+    ctx.run();
+    ctx.restart();
+  }
+  auto elapsed = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+
+  for (auto &q : queues)
+    q->clear();
+
+  return {elapsed / nBroadcasts, double(msg.size())};
+}
+
+int main(int argc, char **argv)
+{
+  size_t bodySize = 4096;
+  size_t nBroadcasts = 20;
+
+  if (argc > 1)
+    bodySize = std::stoul(argv[1]);
+  if (argc > 2)
+    nBroadcasts = std::stoul(argv[2]);
+
+  net::message<BenchMsgType> msg;
+  msg.header.id = BenchMsgType::WorldState;
+  msg.body.resize(bodySize);
+  msg.header.size = msg.size();
+
+  std::cout << "body: " << bodySize << " bytes, broadcasts: " << nBroadcasts << std::endl;
+  std::cout << "clients\tcopy us/bcast\tcopy MB/bcast\tshared us/bcast\tshared MB/bcast" << std::endl;
+
+  for (size_t nClients : {10, 100, 1000, 10000})
+  {
+    std::vector<std::unique_ptr<out_queue>> queues;
+    for (size_t i = 0; i < nClients; i++)
+      queues.emplace_back(std::make_unique<out_queue>());
+
+    result copy = RunCopy(queues, msg, nBroadcasts);
+    result shared = RunShared(queues, msg, nBroadcasts);
+
+    std::cout << nClients << "\t" << copy.usPerBroadcast << "\t\t" << copy.bytesCopiedPerBroadcast / (1024 * 1024) << "\t\t"
+              << shared.usPerBroadcast << "\t\t" << shared.bytesCopiedPerBroadcast / (1024 * 1024) << std::endl;
+  }
+
+  return 0;
+}
@@ -0,0 +1,154 @@
+#include "bench_common.hpp"
+#include <iostream>
+#include <atomic>
+#include <chrono>
+#include <vector>
+#include <string>
+
+/**
+ * 向广播组发送 vs 遍历所有连接再按组过滤
+ * 所有客户端平均分到各个组，每次向一个组广播一条消息，统计发送方每次广播的耗时，以及所有成员收到消息的总耗时
+ * 客户端连接共享一个 io_context 池（同 load-benchmark）
+ * 用法：group-benchmark [客户端数] [组数] [广播次数] [消息体 bytes] [服务端 I/O 线程数]
+ * 注意 1 万个连接在同一个进程中需要 2 万个文件描述符，需要调大 ulimit -n
+ */
+
+enum class BenchMsgType : uint32_t
+{
+  ServerValidated,
+  Update,
+};
+
+class GroupServer : public net::server_interface<BenchMsgType>
+{
+public:
+  GroupServer(uint16_t port, size_t nThreads, uint32_t nGroups) : net::server_interface<BenchMsgType>(port, nThreads), nGroups(nGroups) {}
+
+  // 原来只有 SendMessageAllClients 时的做法：遍历所有连接，按业务记录的组过滤
+  void SendMessageGroupByFilter(uint32_t group, net::shared_message<BenchMsgType> msg)
+  {
+    ForEachClient([&](const std::shared_ptr<net::connection<BenchMsgType>> &client)
+                  {
+      if (client->GetID() % nGroups == group && client->IsConnected())
+        client->Send(msg); });
+  }
+
+protected:
+  uint32_t nGroups;
+
+  virtual void OnClientValidated(std::shared_ptr<net::connection<BenchMsgType>> client)
+  {
+    Subscribe(client->GetID() % nGroups, client);
+
+    net::message<BenchMsgType> msg;
+    msg.header.id = BenchMsgType::ServerValidated;
+    client->Send(std::move(msg));
+  }
+};
+
+int main(int argc, char **argv)
+{
+  size_t nClients = 10000;
+  uint32_t nGroups = 100;
+  size_t nPublishes = 2000;
+  size_t bodySize = 64;
+  size_t nServerThreads = std::max(1u, std::thread::hardware_concurrency() / 2);
+
+  if (argc > 1)
+    nClients = std::stoul(argv[1]);
+  if (argc > 2)
+    nGroups = uint32_t(std::stoul(argv[2]));
+  if (argc > 3)
+    nPublishes = std::stoul(argv[3]);
+  if (argc > 4)
+    bodySize = std::stoul(argv[4]);
+  if (argc > 5)
+    nServerThreads = std::stoul(argv[5]);
+
+  std::cout << "clients: " << nClients << ", groups: " << nGroups << ", publishes: " << nPublishes << ", body: " << bodySize << " bytes" << std::endl;
+
+  uint16_t port = 60400;
+  GroupServer server(port, nServerThreads, nGroups);
+  server.Start();
+
+  net::io_context_pool clientPool(std::max<size_t>(1, std::thread::hardware_concurrency() / 2));
+  clientPool.Run();
+  net::inbound_queue<net::owned_message<BenchMsgType>> clientInQueue;
+
+  std::atomic<bool> receiving(true);
+  std::atomic<uint64_t> validated(0);
+  std::atomic<uint64_t> received(0);
+  std::thread receiver([&]()
+                       {
+    net::pooled_deque<net::owned_message<BenchMsgType>> batch;
+    while (receiving)
+    {
+      clientInQueue.pop_front_batch(batch, size_t(-1));
+      if (batch.empty())
+      {
+        std::this_thread::yield();
+        continue;
+      }
+
+      for (auto &owned : batch)
+      {
+        if (owned.msg.header.id == BenchMsgType::ServerValidated)
+          validated++;
+        else
+          received++;
+      }
+      batch.clear();
+    } });
+
+  auto clients = ConnectPooledClients(clientPool, clientInQueue, port, nClients);
+
+  auto connectDeadline = bench_clock::now() + std::chrono::seconds(60);
+  while (validated < nClients && bench_clock::now() < connectDeadline)
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  std::cout << "validated: " << validated << "/" << nClients << std::endl;
+
+  // 每个组实际的成员数（客户端数不能被组数整除时各组不一样）
+  uint64_t expectedPerRound = 0;
+  for (size_t p = 0; p < nPublishes; p++)
+    expectedPerRound += server.GroupSize(uint32_t(p % nGroups));
+
+  for (bool useGroups : {false, true})
+  {
+    uint64_t receivedBefore = received;
+    double publishSeconds = 0;
+    auto start = bench_clock::now();
+    for (size_t p = 0; p < nPublishes; p++)
+    {
+      net::message<BenchMsgType> msg;
+      msg.header.id = BenchMsgType::Update;
+      msg.body.resize(bodySize);
+      msg.header.size = msg.size();
+      net::shared_message<BenchMsgType> shared = std::make_shared<const net::message<BenchMsgType>>(std::move(msg));
+
+      uint32_t group = uint32_t(p % nGroups);
+      auto publishStart = bench_clock::now();
+      if (useGroups)
+        server.SendMessageGroup(group, shared);
+      else
+        server.SendMessageGroupByFilter(group, shared);
+      publishSeconds += std::chrono::duration<double>(bench_clock::now() - publishStart).count();
+    }
+
+    auto deadline = bench_clock::now() + std::chrono::seconds(60);
+    while (received - receivedBefore < expectedPerRound && bench_clock::now() < deadline)
+      std::this_thread::sleep_for(std::chrono::microseconds(100));
+    double totalSeconds = std::chrono::duration<double>(bench_clock::now() - start).count();
+
+    std::cout << (useGroups ? "SendMessageGroup   " : "filter all clients ") << ": " << publishSeconds * 1e6 / double(nPublishes) << " us per publish, "
+              << "delivered " << received - receivedBefore << "/" << expectedPerRound << " in " << totalSeconds << " s, "
+              << double(received - receivedBefore) / totalSeconds << " deliveries/s" << std::endl;
+  }
+
+  receiving = false;
+  receiver.join();
+  clientPool.Stop();
+  clients.clear();
+  server.Stop();
+
+  return 0;
+}
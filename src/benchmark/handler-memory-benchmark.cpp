@@ -0,0 +1,123 @@
+#include "bench_common.hpp"
+#include "bench_alloc.hpp"
+#include <iostream>
+#include <atomic>
+#include <chrono>
+#include <vector>
+#include <string>
+
+/**
+ * 统计稳定运行后读写路径上的内存分配次数
+ * 替换全局 operator new 计数（bench_alloc.hpp），客户端和服务端之间一问一答地回显，预热之后每一轮输出：
+ * - handler fallbacks：handler_memory 放不下、退回 operator new 的次数，应该为 +0
+ * - operator new：整个进程的分配次数，除以消息数即每条消息的分配次数；定义 NET_DISABLE_HANDLER_MEMORY 重新编译可以对比
+ * handler 的内存来自 handler_memory，message 的 body 和收发队列的 deque 节点来自 buffer_pool，稳定之后 operator new 应该为 +0，最后一轮不为 0 时返回 1
+ * 用法：handler-memory-benchmark [客户端数] [每轮每个客户端消息数] [轮数]
+ */
+
+using BenchMsgType = EchoMsgType;
+
+class EchoClient : public net::client_interface<BenchMsgType>
+{
+public:
+  size_t received = 0;
+
+protected:
+  virtual void OnMessage(const net::message<BenchMsgType> &)
+  {
+    received++;
+  }
+};
+
+// 一问一答地回显 nMessages 条消息，每个客户端同时只有一条消息在路上
+void RunRound(EchoClient *pClient, size_t nMessages)
+{
+  for (size_t i = 0; i < nMessages; i++)
+  {
+    net::message<BenchMsgType> msg;
+    msg.header.id = BenchMsgType::Echo;
+    msg.body.resize(64);
+    msg.header.size = msg.size();
+    pClient->Send(std::move(msg));
+
+    size_t target = pClient->received + 1;
+    while (pClient->received < target)
+      pClient->WaitAndProcess(std::chrono::seconds(1));
+  }
+}
+
+int main(int argc, char **argv)
+{
+  size_t nClients = 4;
+  size_t nMessages = 20000;
+  size_t nRounds = 5;
+
+  if (argc > 1)
+    nClients = std::stoul(argv[1]);
+  if (argc > 2)
+    nMessages = std::stoul(argv[2]);
+  if (argc > 3)
+    nRounds = std::stoul(argv[3]);
+
+  uint16_t port = 60500;
+  EchoServer<BenchMsgType> server(port);
+  server.Start();
+  server.StartPump();
+
+  auto clients = ConnectClients<EchoClient>(port, nClients);
+
+  // 每个客户端一个发送线程，所有轮次共用：每轮新建的线程的 buffer_pool 缓存是空的，会从全局链表抢内存块，别的线程取不到时就要 new
+  // 第 0 轮是预热，让 buffer_pool 的缓存填满，从第 1 轮开始统计
+  std::atomic<size_t> round(0);
+  std::atomic<size_t> done(0);
+  std::vector<std::thread> workers;
+  for (auto &c : clients)
+  {
+    EchoClient *pClient = c.get();
+    workers.emplace_back([pClient, nMessages, nRounds, &round, &done]()
+                         {
+      for (size_t r = 1; r <= nRounds + 1; r++)
+      {
+        while (round < r)
+          std::this_thread::yield();
+        RunRound(pClient, nMessages);
+        done++;
+      } });
+  }
+
+  std::cout << "round\tmessages\thandler fallbacks\toperator new\tnew per message" << std::endl;
+
+  uint64_t lastAllocs = 0;
+  for (size_t r = 0; r <= nRounds; r++)
+  {
+    uint64_t fallbacks = net::handler_memory_fallbacks().load();
+    uint64_t allocs = g_allocs.load();
+    done = 0;
+    round++;
+    while (done < workers.size())
+      std::this_thread::yield();
+    fallbacks = net::handler_memory_fallbacks().load() - fallbacks;
+    allocs = g_allocs.load() - allocs;
+    if (r == 0)
+      continue;
+
+    // 每条消息往返各一次
+    size_t messages = nClients * nMessages * 2;
+    lastAllocs = allocs;
+    std::cout << r << "\t" << messages << "\t\t+" << fallbacks << "\t\t\t+" << allocs << "\t\t" << double(allocs) / double(messages) << std::endl;
+  }
+
+  for (auto &t : workers)
+    t.join();
+  clients.clear();
+  server.StopPump();
+  server.Stop();
+
+  // 客户端多时前几轮 buffer_pool 可能还在增长（偶尔 +1、+2），以最后一轮为准，这时收发路径上不应该再有 new
+  if (lastAllocs > 0)
+  {
+    std::cout << "FAILED: " << lastAllocs << " operator new in the last round" << std::endl;
+    return 1;
+  }
+  return 0;
+}
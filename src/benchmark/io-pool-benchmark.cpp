@@ -0,0 +1,107 @@
+#include "bench_common.hpp"
+#include <iostream>
+#include <array>
+#include <chrono>
+#include <vector>
+#include <string>
+
+/**
+ * 服务端 I/O 线程数从 1 增加到 N，测试回显吞吐量（messages/sec），每个线程数测两种回显：
+ * - Update()：消息进入共享的接收队列，由一个 Update() 线程回显，瓶颈在这个线程上，增加 I/O 线程反而多了跨线程的开销
+ * - I/O 线程：在 OnIOMessage 中直接回显，每条消息的处理都在连接自己的 I/O 线程上，这才是 I/O 线程池能并行的部分
+ * 用法：io-pool-benchmark [最大 I/O 线程数] [客户端数] [每个客户端消息数] [消息体 bytes]
+ */
+
+using BenchMsgType = EchoMsgType;
+
+// 在 I/O 线程中直接回显，消息不进入接收队列
+class IOEchoServer : public BenchServer<BenchMsgType>
+{
+public:
+  using BenchServer<BenchMsgType>::BenchServer;
+
+  virtual bool OnIOMessage(const std::shared_ptr<net::connection<BenchMsgType>> &client, const net::message<BenchMsgType> &msg)
+  {
+    client->Send(msg);
+    return true;
+  }
+};
+
+template <typename Server>
+double RunOnce(uint16_t port, size_t nThreads, size_t nClients, size_t nMessages, size_t bodySize)
+{
+  Server server(port, nThreads);
+  server.Start();
+  server.StartPump();
+
+  auto clients = ConnectClients<net::client_interface<BenchMsgType>>(port, nClients);
+
+  net::message<BenchMsgType> msg;
+  msg.header.id = BenchMsgType::Echo;
+  msg.body.resize(bodySize);
+  msg.header.size = msg.size();
+
+  auto start = std::chrono::steady_clock::now();
+
+  std::vector<std::thread> workers;
+  for (auto &c : clients)
+  {
+    net::client_interface<BenchMsgType> *pClient = c.get();
+    workers.emplace_back([pClient, &msg, nMessages]()
+                         {
+      for (size_t i = 0; i < nMessages; i++)
+        pClient->Send(msg);
+
+      for (size_t i = 0; i < nMessages; i++)
+      {
+        pClient->InComing().wait();
+        pClient->InComing().pop_front();
+      } });
+  }
+
+  for (auto &t : workers)
+    t.join();
+
+  auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  clients.clear();
+  server.StopPump();
+  server.Stop();
+
+  // 每条消息都被服务端接收并回显一次
+  return double(nClients * nMessages) / elapsed;
+}
+
+int main(int argc, char **argv)
+{
+  size_t maxThreads = std::max(1u, std::thread::hardware_concurrency());
+  size_t nClients = 16;
+  size_t nMessages = 20000;
+  size_t bodySize = 256;
+
+  if (argc > 1)
+    maxThreads = std::stoul(argv[1]);
+  if (argc > 2)
+    nClients = std::stoul(argv[2]);
+  if (argc > 3)
+    nMessages = std::stoul(argv[3]);
+  if (argc > 4)
+    bodySize = std::stoul(argv[4]);
+
+  std::cout << "clients: " << nClients << ", messages/client: " << nMessages << ", body: " << bodySize << " bytes" << std::endl;
+
+  std::vector<std::array<double, 2>> results;
+  for (size_t nThreads = 1; nThreads <= maxThreads; nThreads++)
+  {
+    double updateRate = RunOnce<EchoServer<BenchMsgType>>(uint16_t(60000 + nThreads * 2), nThreads, nClients, nMessages, bodySize);
+    double ioRate = RunOnce<IOEchoServer>(uint16_t(60001 + nThreads * 2), nThreads, nClients, nMessages, bodySize);
+    results.push_back({updateRate, ioRate});
+  }
+
+  std::cout << std::endl
+            << "I/O threads\tUpdate() echo (msg/s)\tI/O thread echo (msg/s)" << std::endl;
+  for (size_t i = 0; i < results.size(); i++)
+    std::cout << i + 1 << "\t\t" << size_t(results[i][0]) << "\t\t\t" << size_t(results[i][1]) << std::endl;
+
+  return 0;
+}
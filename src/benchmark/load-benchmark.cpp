@@ -0,0 +1,174 @@
+#include "bench_common.hpp"
+#include "net_common/net_histogram.hpp"
+#include <iostream>
+#include <atomic>
+#include <chrono>
+#include <vector>
+#include <string>
+
+/**
+ * 压测：同一个进程中启动服务端和大量客户端连接（走 loopback），按固定速率发送回显消息
+ * 输出握手速率、吞吐量和往返延迟的 p50/p99/p999
+ * 客户端连接共享一个 io_context 池，而不是每个 client_interface 一个线程，这样才能开到几千个连接
+ * 用法：load-benchmark [客户端数] [消息体 bytes] [每个客户端每秒消息数] [秒数] [服务端 I/O 线程数] [客户端 I/O 线程数] [sharded]
+ * 最后一个参数为 sharded 时服务端每个 I/O 线程一个 SO_REUSEPORT acceptor，用来对比握手速率
+ * 注意几千个连接需要调大进程的文件描述符上限（ulimit -n）
+ */
+
+using BenchMsgType = EchoMsgType;
+
+uint64_t NowNs()
+{
+  return uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(bench_clock::now().time_since_epoch()).count());
+}
+
+void PrintHistogram(const char *name, const net::latency_histogram &h)
+{
+  std::cout << name << " (us): p50 " << h.Percentile(50) / 1000.0
+            << ", p99 " << h.Percentile(99) / 1000.0
+            << ", p999 " << h.Percentile(99.9) / 1000.0
+            << ", max " << h.Max() / 1000.0 << std::endl;
+}
+
+int main(int argc, char **argv)
+{
+  size_t nClients = 1000;
+  size_t bodySize = 64;
+  double ratePerClient = 10;
+  double seconds = 5;
+  size_t nServerThreads = std::max(1u, std::thread::hardware_concurrency() / 2);
+  size_t nClientThreads = std::max(1u, std::thread::hardware_concurrency() / 2);
+  bool sharded = false;
+
+  if (argc > 1)
+    nClients = std::stoul(argv[1]);
+  if (argc > 2)
+    bodySize = std::max<size_t>(sizeof(uint64_t), std::stoul(argv[2]));
+  if (argc > 3)
+    ratePerClient = std::stod(argv[3]);
+  if (argc > 4)
+    seconds = std::stod(argv[4]);
+  if (argc > 5)
+    nServerThreads = std::stoul(argv[5]);
+  if (argc > 6)
+    nClientThreads = std::stoul(argv[6]);
+  if (argc > 7)
+    sharded = std::string(argv[7]) == "sharded";
+
+  std::cout << "clients: " << nClients << ", body: " << bodySize << " bytes, rate: " << ratePerClient << " msg/s/client"
+            << ", duration: " << seconds << " s, server threads: " << nServerThreads << ", client threads: " << nClientThreads << (sharded ? ", sharded" : "") << std::endl;
+
+  uint16_t port = 60200;
+  EchoServer<BenchMsgType> server(port, nServerThreads, sharded);
+  server.Start();
+  server.StartPump();
+
+  // 所有客户端连接共享的 I/O 线程和接收队列，收到的消息 remote 都是 nullptr，延迟从消息体中的时间戳计算
+  net::io_context_pool clientPool(nClientThreads);
+  clientPool.Run();
+  net::inbound_queue<net::owned_message<BenchMsgType>> clientInQueue;
+
+  std::atomic<bool> receiving(true);
+  std::atomic<uint64_t> validated(0);
+  std::atomic<uint64_t> received(0);
+  net::latency_histogram rtt;
+  net::latency_histogram handshake;
+  uint64_t connectStartNs = 0;
+
+  std::thread receiver([&]()
+                       {
+    net::pooled_deque<net::owned_message<BenchMsgType>> batch;
+    while (receiving)
+    {
+      clientInQueue.pop_front_batch(batch, size_t(-1));
+      if (batch.empty())
+      {
+        std::this_thread::yield();
+        continue;
+      }
+
+      uint64_t now = NowNs();
+      for (auto &owned : batch)
+      {
+        if (owned.msg.header.id == BenchMsgType::ServerValidated)
+        {
+          handshake.Record(now - connectStartNs);
+          validated++;
+        }
+        else
+        {
+          uint64_t sentNs = 0;
+          owned.msg.reader().read(sentNs);
+          rtt.Record(now - sentNs);
+          received++;
+        }
+      }
+      batch.clear();
+    } });
+
+  // 建立连接并等待全部验证通过
+  connectStartNs = NowNs();
+  auto clients = ConnectPooledClients(clientPool, clientInQueue, port, nClients);
+
+  auto connectDeadline = bench_clock::now() + std::chrono::seconds(30);
+  while (validated < nClients && bench_clock::now() < connectDeadline)
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+  double connectSeconds = double(NowNs() - connectStartNs) / 1e9;
+  std::cout << std::endl
+            << "validated: " << validated << "/" << nClients << " in " << connectSeconds << " s, "
+            << double(validated) / connectSeconds << " handshakes/s" << std::endl;
+  PrintHistogram("handshake", handshake);
+
+  // 开环压测：按总速率均匀地轮流让每个客户端发送，不等待回显
+  double totalRate = ratePerClient * double(nClients);
+  uint64_t totalToSend = uint64_t(totalRate * seconds);
+  uint64_t sent = 0;
+
+  auto start = bench_clock::now();
+  while (sent < totalToSend)
+  {
+    auto due = start + std::chrono::duration_cast<bench_clock::duration>(std::chrono::duration<double>(double(sent) / totalRate));
+    if (due > bench_clock::now())
+      std::this_thread::sleep_until(due);
+
+    net::message<BenchMsgType> msg;
+    msg.header.id = BenchMsgType::Echo;
+    msg.body.resize(bodySize);
+    uint64_t nowNs = NowNs();
+    std::memcpy(msg.body.data(), &nowNs, sizeof(uint64_t));
+    msg.header.size = msg.size();
+
+    clients[sent % clients.size()]->Send(std::move(msg));
+    sent++;
+  }
+
+  // 等待在途的回显
+  auto drainDeadline = bench_clock::now() + std::chrono::seconds(10);
+  while (received < sent && bench_clock::now() < drainDeadline)
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+  double elapsed = std::chrono::duration<double>(bench_clock::now() - start).count();
+
+  std::cout << "sent: " << sent << ", echoed: " << received << ", throughput: " << double(received) / elapsed << " msg/s, "
+            << double(received) * double(bodySize + sizeof(net::message_header<BenchMsgType>)) / elapsed / (1024 * 1024) << " MiB/s each way" << std::endl;
+  PrintHistogram("round trip", rtt);
+
+  // 服务端自己的统计
+  auto metrics = server.GetMetrics();
+  std::cout << "server: clients " << metrics.clientCount << ", messages in " << metrics.totals.messagesIn << ", out " << metrics.totals.messagesOut
+            << ", bytes in " << metrics.totals.bytesIn << ", out " << metrics.totals.bytesOut
+            << ", handshake failures " << metrics.totals.handshakeFailures << std::endl;
+  std::cout << "server in queue (us): p50 " << metrics.inQueueTime.p50 / 1000.0 << ", p99 " << metrics.inQueueTime.p99 / 1000.0 << ", max " << metrics.inQueueTime.max / 1000.0 << std::endl;
+  std::cout << "server out queue (us): p50 " << metrics.outQueueTime.p50 / 1000.0 << ", p99 " << metrics.outQueueTime.p99 / 1000.0 << ", max " << metrics.outQueueTime.max / 1000.0 << std::endl;
+
+  receiving = false;
+  receiver.join();
+  clientPool.Stop();
+  clients.clear();
+
+  server.StopPump();
+  server.Stop();
+
+  return 0;
+}
@@ -0,0 +1,77 @@
+#include "net_common/net_tsqueue.hpp"
+#include "net_common/net_lfqueue.hpp"
+#include <iostream>
+#include <atomic>
+#include <chrono>
+#include <vector>
+#include <thread>
+#include <string>
+
+/**
+ * tsqueue 和无锁队列 mpsc_queue 的对比，1 个消费者，生产者线程数从 1 到 16
+ * 用法：queue-benchmark [每个生产者写入的元素个数]
+ */
+
+struct Item
+{
+  uint64_t producer;
+  uint64_t seq;
+};
+
+template <typename Queue>
+double RunOnce(Queue &q, size_t nProducers, size_t nItems)
+{
+  std::atomic<bool> go(false);
+  std::vector<std::thread> producers;
+  for (size_t p = 0; p < nProducers; p++)
+  {
+    producers.emplace_back([&q, &go, p, nItems]()
+                           {
+      while (!go)
+        std::this_thread::yield();
+      for (size_t i = 0; i < nItems; i++)
+        q.emplace_back(Item{p, i}); });
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  go = true;
+
+  // 单消费者，和服务端 Update() 一样先 wait 再 pop_front
+  size_t total = nProducers * nItems;
+  uint64_t checksum = 0;
+  for (size_t i = 0; i < total; i++)
+  {
+    q.wait();
+    checksum += q.pop_front().seq;
+  }
+
+  auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  for (auto &t : producers)
+    t.join();
+
+  if (checksum != nProducers * (nItems * (nItems - 1) / 2))
+    std::cout << "checksum mismatch!" << std::endl;
+
+  return double(total) / elapsed;
+}
+
+int main(int argc, char **argv)
+{
+  size_t nItems = 200000;
+  if (argc > 1)
+    nItems = std::stoul(argv[1]);
+
+  std::cout << "items/producer: " << nItems << std::endl;
+  std::cout << "producers\ttsqueue ops/sec\tmpsc_queue ops/sec" << std::endl;
+  for (size_t nProducers : {1, 2, 4, 8, 16})
+  {
+    net::tsqueue<Item> tsq;
+    net::mpsc_queue<Item> mpscq(64 * 1024);
+    double tsRate = RunOnce(tsq, nProducers, nItems);
+    double lfRate = RunOnce(mpscq, nProducers, nItems);
+    std::cout << nProducers << "\t\t" << size_t(tsRate) << "\t\t" << size_t(lfRate) << std::endl;
+  }
+
+  return 0;
+}
@@ -0,0 +1,144 @@
+#include "net_common/net_message.hpp"
+#include "net_common/net_schema.hpp"
+#include <iostream>
+#include <chrono>
+#include <string>
+#include <vector>
+
+/**
+ * 定长消息体的编码/解码耗时：<<、>> 逐个字段 vs write/read 一次多个字段 vs schema
+ * - PlayerState 没有填充，小端主机上 schema 整个结构体一次 memcpy
+ * - PaddedState 有填充，schema 逐个字段编码，可以看出字段级编码本身的开销
+ * 每次编码都复用同一个 message（只 clear body），不计内存分配
+ * 用法：schema-benchmark [次数]
+ */
+
+enum class BenchMsgType : uint32_t
+{
+  State,
+};
+
+using bench_clock = std::chrono::steady_clock;
+
+struct PlayerState
+{
+  uint32_t id;
+  float x, y, z;
+  float vx, vy, vz;
+  uint16_t hp;
+  uint8_t team;
+  uint8_t flags;
+};
+
+template <>
+struct net::schema<PlayerState> : net::schema_fields<&PlayerState::id, &PlayerState::x, &PlayerState::y, &PlayerState::z,
+                                                     &PlayerState::vx, &PlayerState::vy, &PlayerState::vz,
+                                                     &PlayerState::hp, &PlayerState::team, &PlayerState::flags>
+{
+};
+static_assert(net::schema<PlayerState>::WireBytes == 32, "PlayerState wire format changed");
+
+struct PaddedState
+{
+  uint8_t team;
+  uint32_t id;
+  uint16_t hp;
+  double x, y, z;
+};
+
+template <>
+struct net::schema<PaddedState> : net::schema_fields<&PaddedState::team, &PaddedState::id, &PaddedState::hp,
+                                                     &PaddedState::x, &PaddedState::y, &PaddedState::z>
+{
+};
+static_assert(net::schema<PaddedState>::WireBytes == 31, "PaddedState wire format changed");
+
+template <typename F>
+void Measure(const char *name, size_t nIterations, F &&body)
+{
+  auto start = bench_clock::now();
+  uint64_t checksum = 0;
+  for (size_t i = 0; i < nIterations; i++)
+    checksum += body(uint32_t(i));
+  double seconds = std::chrono::duration<double>(bench_clock::now() - start).count();
+
+  std::cout << name << ": " << seconds * 1e9 / double(nIterations) << " ns per message (checksum " << checksum << ")" << std::endl;
+}
+
+int main(int argc, char **argv)
+{
+  size_t nIterations = 10000000;
+  if (argc > 1)
+    nIterations = std::stoul(argv[1]);
+
+  std::cout << "PlayerState: " << sizeof(PlayerState) << " bytes in memory, " << net::schema<PlayerState>::WireBytes << " bytes on wire, memcpy: " << (net::schema<PlayerState>::MaybeMemcpy && net::schema<PlayerState>::LayoutMatches()) << std::endl;
+  std::cout << "PaddedState: " << sizeof(PaddedState) << " bytes in memory, " << net::schema<PaddedState>::WireBytes << " bytes on wire, memcpy: " << (net::schema<PaddedState>::MaybeMemcpy && net::schema<PaddedState>::LayoutMatches()) << std::endl;
+
+  // 输入来自数组，避免编译器把常量直接折叠进编码
+  std::vector<PlayerState> players(1024);
+  std::vector<PaddedState> padded(1024);
+  for (size_t i = 0; i < players.size(); i++)
+  {
+    players[i] = PlayerState{uint32_t(i), float(i), 2.0f, 3.0f, 0.5f, 0.0f, -0.5f, uint16_t(i % 100), uint8_t(i % 4), 0};
+    padded[i] = PaddedState{uint8_t(i % 4), uint32_t(i), uint16_t(i % 100), double(i), 2.0, 3.0};
+  }
+
+  net::message<BenchMsgType> msg;
+  msg.header.id = BenchMsgType::State;
+  msg.reserve(64);
+
+  Measure("PlayerState <<, >>        ", nIterations, [&](uint32_t i)
+          {
+    const PlayerState &s = players[i % players.size()];
+    msg.body.clear();
+    msg << s.id << s.x << s.y << s.z << s.vx << s.vy << s.vz << s.hp << s.team << s.flags;
+
+    PlayerState out{};
+    msg >> out.flags >> out.team >> out.hp >> out.vz >> out.vy >> out.vx >> out.z >> out.y >> out.x >> out.id;
+    return uint64_t(out.id) + out.hp; });
+
+  Measure("PlayerState write, read   ", nIterations, [&](uint32_t i)
+          {
+    const PlayerState &s = players[i % players.size()];
+    msg.body.clear();
+    msg.write(s.id, s.x, s.y, s.z, s.vx, s.vy, s.vz, s.hp, s.team, s.flags);
+
+    PlayerState out{};
+    auto r = msg.reader();
+    r.read(out.id, out.x, out.y, out.z, out.vx, out.vy, out.vz, out.hp, out.team, out.flags);
+    return uint64_t(out.id) + out.hp; });
+
+  Measure("PlayerState schema        ", nIterations, [&](uint32_t i)
+          {
+    const PlayerState &s = players[i % players.size()];
+    msg.body.clear();
+    net::write_schema(msg, s);
+
+    PlayerState out{};
+    auto r = msg.reader();
+    net::read_schema(r, out);
+    return uint64_t(out.id) + out.hp; });
+
+  Measure("PaddedState <<, >>        ", nIterations, [&](uint32_t i)
+          {
+    const PaddedState &s = padded[i % padded.size()];
+    msg.body.clear();
+    msg << s.team << s.id << s.hp << s.x << s.y << s.z;
+
+    PaddedState out{};
+    msg >> out.z >> out.y >> out.x >> out.hp >> out.id >> out.team;
+    return uint64_t(out.id) + out.hp; });
+
+  Measure("PaddedState schema        ", nIterations, [&](uint32_t i)
+          {
+    const PaddedState &s = padded[i % padded.size()];
+    msg.body.clear();
+    net::write_schema(msg, s);
+
+    PaddedState out{};
+    auto r = msg.reader();
+    net::read_schema(r, out);
+    return uint64_t(out.id) + out.hp; });
+
+  return 0;
+}
@@ -0,0 +1,133 @@
+#include "net_common/net_message.hpp"
+#include <iostream>
+#include <chrono>
+#include <string>
+#include <vector>
+
+/**
+ * 变长数据（聊天文本、坐标数组）的编码/解码耗时
+ * - byte loop：原来的做法，先写长度，再用 << 逐个字符/元素写入，读取时逐个 >> 追加到 std::string/std::vector
+ * - varlen：msg << text 写入 varint 长度 + 一次 memcpy，读取为 std::string_view/array_view（不拷贝）或 std::string/std::vector（拷贝一次）
+ * 每次编码都复用同一个 message（只 clear body），不计内存分配
+ * 用法：varlen-benchmark [次数]
+ */
+
+enum class BenchMsgType : uint32_t
+{
+  Chat,
+};
+
+using bench_clock = std::chrono::steady_clock;
+
+template <typename F>
+void Measure(const std::string &name, size_t nIterations, F &&body)
+{
+  auto start = bench_clock::now();
+  uint64_t checksum = 0;
+  for (size_t i = 0; i < nIterations; i++)
+    checksum += body();
+  double seconds = std::chrono::duration<double>(bench_clock::now() - start).count();
+
+  std::cout << name << ": " << seconds * 1e9 / double(nIterations) << " ns per message (checksum " << checksum << ")" << std::endl;
+}
+
+int main(int argc, char **argv)
+{
+  size_t nIterations = 1000000;
+  if (argc > 1)
+    nIterations = std::stoul(argv[1]);
+
+  net::message<BenchMsgType> msg;
+  msg.header.id = BenchMsgType::Chat;
+
+  for (size_t length : {16, 256, 4096})
+  {
+    std::string text(length, 'a');
+    for (size_t i = 0; i < length; i++)
+      text[i] = char('a' + i % 26);
+    std::vector<float> points(length / sizeof(float), 1.5f);
+    msg.reserve(length * 2 + 64);
+
+    std::cout << "--- " << length << " bytes ---" << std::endl;
+
+    Measure("text byte loop      ", nIterations / length * 16, [&]()
+            {
+      msg.body.clear();
+      msg << uint32_t(text.size());
+      for (char c : text)
+        msg << c;
+
+      auto r = msg.reader();
+      uint32_t n = 0;
+      r >> n;
+      std::string out;
+      for (uint32_t i = 0; i < n; i++)
+      {
+        char c = 0;
+        r >> c;
+        out.push_back(c);
+      }
+      return uint64_t(out.size()) + uint8_t(out.back()); });
+
+    Measure("text string_view    ", nIterations / length * 16, [&]()
+            {
+      msg.body.clear();
+      msg << text;
+
+      auto r = msg.reader();
+      std::string_view out;
+      r >> out;
+      return uint64_t(out.size()) + uint8_t(out.back()); });
+
+    Measure("text std::string    ", nIterations / length * 16, [&]()
+            {
+      msg.body.clear();
+      msg << text;
+
+      auto r = msg.reader();
+      std::string out;
+      r >> out;
+      return uint64_t(out.size()) + uint8_t(out.back()); });
+
+    Measure("floats byte loop    ", nIterations / length * 16, [&]()
+            {
+      msg.body.clear();
+      msg << uint32_t(points.size());
+      for (float f : points)
+        msg << f;
+
+      auto r = msg.reader();
+      uint32_t n = 0;
+      r >> n;
+      std::vector<float> out;
+      for (uint32_t i = 0; i < n; i++)
+      {
+        float f = 0;
+        r >> f;
+        out.push_back(f);
+      }
+      return uint64_t(out.size()) + uint64_t(out.back()); });
+
+    Measure("floats array_view   ", nIterations / length * 16, [&]()
+            {
+      msg.body.clear();
+      msg << points;
+
+      auto r = msg.reader();
+      net::array_view<float> out;
+      r >> out;
+      return uint64_t(out.size()) + uint64_t(out[out.size() - 1]); });
+
+    Measure("floats std::vector  ", nIterations / length * 16, [&]()
+            {
+      msg.body.clear();
+      msg << points;
+
+      auto r = msg.reader();
+      std::vector<float> out;
+      r >> out;
+      return uint64_t(out.size()) + uint64_t(out.back()); });
+  }
+
+  return 0;
+}
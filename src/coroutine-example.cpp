@@ -0,0 +1,90 @@
+#ifdef _WIN32
+#define _WIN32_WINNT 0x0A00
+#endif
+#include "net_common/net_server.hpp"
+#include "net_common/net_coroutine.hpp"
+#include <iostream>
+#include <future>
+
+// 需要 C++20 编译，并且 asio 开启了 co_await 支持
+
+enum class CustomMsgType : uint32_t
+{
+  ServerValidated,
+  ServerPing,
+};
+
+class CustomServer : public net::server_interface<CustomMsgType>
+{
+public:
+  CustomServer(uint16_t port) : net::server_interface<CustomMsgType>(port) {}
+
+protected:
+  virtual void OnClientValidated(std::shared_ptr<net::connection<CustomMsgType>> client)
+  {
+    net::message<CustomMsgType> msg;
+    msg.header.id = CustomMsgType::ServerValidated;
+    client->Send(std::move(msg));
+  }
+
+  virtual void OnMessage(std::shared_ptr<net::connection<CustomMsgType>> client, const net::message<CustomMsgType> &msg)
+  {
+    if (msg.header.id == CustomMsgType::ServerPing)
+    {
+      // 原样返回，Reply 会把请求的 correlation 拷贝到响应中
+      Reply(client, msg, msg);
+    }
+  }
+};
+
+int main()
+{
+  CustomServer server(5050);
+  server.Start();
+  std::thread serverThread([&]()
+                           {
+    // 等待客户端的 5 次 ping
+    size_t handled = 0;
+    while (handled < 5)
+      handled += server.Update(size_t(-1), true); });
+
+  net::co_client<CustomMsgType> client;
+  client.Connect("127.0.0.1", 5050);
+
+  std::promise<void> done;
+  client.Spawn([&]() -> asio::awaitable<void>
+               {
+    try
+    {
+      // 验证通过之前不能发送消息
+      auto validated = co_await client.Receive();
+      std::cout << "Server validated: " << validated << std::endl;
+
+      for (int i = 0; i < 5; i++)
+      {
+        net::message<CustomMsgType> ping;
+        ping.header.id = CustomMsgType::ServerPing;
+        auto timeNow = std::chrono::steady_clock::now();
+        ping << timeNow;
+
+        // 不需要轮询 InComing()，响应到达时协程直接恢复；最多等待 1 秒，超时返回空
+        std::optional<net::message<CustomMsgType>> pong = co_await client.Request(std::move(ping), std::chrono::seconds(1));
+        if (!pong)
+        {
+          std::cout << "Ping " << i << ": timeout" << std::endl;
+          continue;
+        }
+        std::cout << "Ping " << i << ": " << std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - timeNow).count() << " us" << std::endl;
+      }
+    }
+    catch (const std::system_error &e)
+    {
+      // 连接失败或者断开
+      std::cout << "Disconnected: " << e.what() << std::endl;
+    }
+    done.set_value(); });
+
+  done.get_future().wait();
+  serverThread.join();
+  return 0;
+}
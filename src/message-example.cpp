@@ -1,5 +1,6 @@
 #include <iostream>
 #include "net_common/net_message.hpp"
+#include "net_common/net_schema.hpp"
 
 enum class SystemMessage : uint32_t
 {
@@ -7,6 +8,21 @@ enum class SystemMessage : uint32_t
   MovePlayer
 };
 
+struct PlayerMove
+{
+  uint32_t id{};
+  float x{}, y{};
+  uint16_t hp{};
+  uint16_t flags{};
+};
+
+// 定长消息体，两端共用同一份字段声明
+template <>
+struct net::schema<PlayerMove> : net::schema_fields<&PlayerMove::id, &PlayerMove::x, &PlayerMove::y, &PlayerMove::hp, &PlayerMove::flags>
+{
+};
+static_assert(net::schema<PlayerMove>::WireBytes == 16, "PlayerMove wire format changed");
+
 int main()
 {
   net::message<SystemMessage> msg;
@@ -48,5 +64,46 @@ int main()
     std::cout << "d[" << i << +"]: " << d[i].x << "," << d[i].y << std::endl;
   }
 
+  // 一次写入多个字段，按写入顺序读取，读取不会修改消息
+  net::message<SystemMessage> fire;
+  fire.header.id = SystemMessage::FireBullet;
+  fire.reserve(sizeof(int) + sizeof(float) * 2);
+  fire.write(a, d[0].x, d[0].y);
+
+  int id{};
+  float x{}, y{};
+  auto reader = fire.reader();
+  reader >> id >> x >> y;
+
+  std::cout << fire << std::endl;
+  std::cout << "id: " << id << ", x: " << x << ", y: " << y << ", ok: " << bool(reader) << ", remaining: " << reader.remaining() << std::endl;
+
+  // 按 schema 编码整个结构体
+  net::message<SystemMessage> move;
+  move.header.id = SystemMessage::MovePlayer;
+  net::write_schema(move, PlayerMove{7, 1.5f, 2.5f, 100, 0});
+
+  PlayerMove received{};
+  auto moveReader = move.reader();
+  net::read_schema(moveReader, received);
+
+  std::cout << move << std::endl;
+  std::cout << "id: " << received.id << ", x: " << received.x << ", y: " << received.y << ", hp: " << received.hp << ", ok: " << bool(moveReader) << std::endl;
+
+  // 变长数据写入 varint 长度 + 内容，读取为指向 body 内部的 string_view
+  net::message<SystemMessage> chat;
+  chat.header.id = SystemMessage::MovePlayer;
+  chat.write(received.id, std::string_view("hello"));
+  chat << std::vector<float>{1.0f, 2.0f, 3.0f};
+
+  uint32_t sender{};
+  std::string_view text;
+  net::array_view<float> values;
+  auto chatReader = chat.reader();
+  chatReader >> sender >> text >> values;
+
+  std::cout << chat << std::endl;
+  std::cout << "sender: " << sender << ", text: " << text << ", values: " << values.size() << ", ok: " << bool(chatReader) << std::endl;
+
   return 0;
 }
\ No newline at end of file
@@ -26,14 +26,63 @@ public:
     std::chrono::system_clock::time_point timeNow = std::chrono::system_clock::now();
 
     msg << timeNow;
-    Send(msg);
+    Send(std::move(msg));
   }
 
   void MessageAll()
   {
     net::message<CustomMsgType> msg;
     msg.header.id = CustomMsgType::MessageAll;
-    Send(msg);
+    Send(std::move(msg));
+  }
+
+  ~CustomClient()
+  {
+    StopWorker();
+  }
+
+protected:
+  // 在 StartWorker() 启动的后台线程中调用，没有消息时该线程睡眠等待
+  virtual void OnMessage(const net::message<CustomMsgType> &msg)
+  {
+    switch (msg.header.id)
+    {
+    case CustomMsgType::ServerAccept:
+    {
+      std::cout << "Server accepted" << std::endl;
+      break;
+    }
+    case CustomMsgType::ServerValidated:
+    {
+      std::cout << "Server validated" << std::endl;
+      break;
+    }
+    case CustomMsgType::ServerDeny:
+    {
+      std::cout << "Server denied" << std::endl;
+      break;
+    }
+    case CustomMsgType::ServerPing:
+    {
+      std::chrono::system_clock::time_point timeNow = std::chrono::system_clock::now();
+      std::chrono::system_clock::time_point timeLast{};
+      auto r = msg.reader();
+      r >> timeLast;
+      // 消息体不完整时 reader 失败，timeLast 没有被写入
+      if (r)
+        std::cout << "Server ping: " << std::chrono::duration<double>(timeNow - timeLast).count() << std::endl;
+      break;
+    }
+    case CustomMsgType::ServerMessage:
+    {
+      uint32_t clientId{};
+      auto r = msg.reader();
+      r >> clientId;
+      if (r)
+        std::cout << "Hello from [" << clientId << "]" << std::endl;
+      break;
+    }
+    }
   }
 };
 
@@ -41,74 +90,27 @@ int main()
 {
   CustomClient c;
   c.Connect("127.0.0.1", 5050);
+  c.StartWorker();
 
   std::cout << "Press 1: Ping Server" << std::endl;
   std::cout << "Press 2: Send Hello to All Other Clients" << std::endl;
   std::cout << "Press 3: Exit" << std::endl;
 
+  // 收到的消息由后台线程处理，主线程只需要阻塞读取命令
   int command = 0;
-  int exit = false;
-
-  std::thread t([&]()
-                {while (!exit)
-                {
-                  std::cin >> command;
-                } });
-
-  while (!exit)
+  while (std::cin >> command && command != 3)
   {
-    if (c.IsConnected())
+    if (!c.IsConnected())
     {
-      if (command == 1)
-        c.PingServer();
-      if (command == 2)
-        c.MessageAll();
-      if (command == 3)
-        exit = true;
-
-      command = 0;
-
-      if (!c.InComing().empty())
-      {
-        auto msg = c.InComing().pop_front().msg;
-        switch (msg.header.id)
-        {
-        case CustomMsgType::ServerAccept:
-        {
-          std::cout << "Server accepted" << std::endl;
-          break;
-        }
-        case CustomMsgType::ServerValidated:
-        {
-          std::cout << "Server validated" << std::endl;
-          break;
-        }
-        case CustomMsgType::ServerDeny:
-        {
-          std::cout << "Server denied" << std::endl;
-          break;
-        }
-        case CustomMsgType::ServerPing:
-        {
-          std::chrono::system_clock::time_point timeNow = std::chrono::system_clock::now();
-          std::chrono::system_clock::time_point timeLast;
-          msg >> timeLast;
-          std::cout << "Server ping: " << std::chrono::duration<double>(timeNow - timeLast).count() << std::endl;
-          break;
-        }
-        case CustomMsgType::ServerMessage:
-        {
-          uint32_t clientId;
-          msg >> clientId;
-          std::cout << "Hello from [" << clientId << "]" << std::endl;
-        }
-        }
-      }
+      std::cout << "Server down" << std::endl;
+      break;
     }
-  }
 
-  if (t.joinable())
-    t.join();
+    if (command == 1)
+      c.PingServer();
+    if (command == 2)
+      c.MessageAll();
+  }
 
   return 0;
 }
\ No newline at end of file
@@ -18,14 +18,29 @@ enum class CustomMsgType : uint32_t
 class CustomServer : public net::server_interface<CustomMsgType>
 {
 public:
-  CustomServer(uint16_t port) : net::server_interface<CustomMsgType>(port) {}
+  CustomServer(uint16_t port) : net::server_interface<CustomMsgType>(port)
+  {
+    // 按消息类型注册处理函数，没有注册的类型进入 OnMessage
+    On(CustomMsgType::ServerPing, [](const std::shared_ptr<net::connection<CustomMsgType>> &client, const net::message<CustomMsgType> &msg)
+       {
+      std::cout << "[" << client->GetID() << "]" << "Server ping" << std::endl;
+      client->Send(msg); });
+
+    On(CustomMsgType::MessageAll, [this](const std::shared_ptr<net::connection<CustomMsgType>> &client, const net::message<CustomMsgType> &)
+       {
+      std::cout << "[" << client->GetID() << "]" << "MessageAll" << std::endl;
+      net::message<CustomMsgType> msg;
+      msg.header.id = CustomMsgType::ServerMessage;
+      msg << client->GetID();
+      SendMessageAllClients(std::move(msg), client); });
+  }
 
 protected:
   virtual bool OnClientConnect(std::shared_ptr<net::connection<CustomMsgType>> client)
   {
     net::message<CustomMsgType> msg;
     msg.header.id = CustomMsgType::ServerAccept;
-    client->Send(msg);
+    client->Send(std::move(msg));
     return true;
   }
 
@@ -33,35 +48,13 @@ protected:
   {
     net::message<CustomMsgType> msg;
     msg.header.id = CustomMsgType::ServerValidated;
-    client->Send(msg);
+    client->Send(std::move(msg));
   }
 
   virtual void OnClientDisConnect(std::shared_ptr<net::connection<CustomMsgType>> client)
   {
     std::cout << "Removing client [" << client->GetID() << "], Remain client count: " << ClientCount() << std::endl;
   }
-
-  virtual void OnMessage(std::shared_ptr<net::connection<CustomMsgType>> client, const net::message<CustomMsgType> &msg)
-  {
-    switch (msg.header.id)
-    {
-    case CustomMsgType::ServerPing:
-    {
-      std::cout << "[" << client->GetID() << "]" << "Server ping" << std::endl;
-      client->Send(msg);
-      break;
-    }
-    case CustomMsgType::MessageAll:
-    {
-      std::cout << "[" << client->GetID() << "]" << "MessageAll" << std::endl;
-      net::message<CustomMsgType> msg;
-      msg.header.id = CustomMsgType::ServerMessage;
-      msg << client->GetID();
-      SendMessageAllClients(msg, client);
-      break;
-    }
-    }
-  }
 };
 
 int main()
@@ -71,7 +64,8 @@ int main()
 
   while (true)
   {
-    server.Update();
+    // 有消息时一次处理队列中所有的消息，没有消息时休眠等待
+    server.Update(size_t(-1), true);
   }
 
   return 0;